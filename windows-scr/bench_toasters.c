@@ -0,0 +1,308 @@
+/*
+ * Flying Toasters - Headless Renderer Benchmark
+ *
+ * Drives the screensaver's renderFrame against an offscreen DIB section
+ * (never the desktop) with a fixed timestep and seed, sweeping resolution,
+ * toaster count and effect toggles. Prints one JSON document to stdout.
+ *
+ * Build: make bench   (or build_msvc.bat bench)
+ *
+ * Usage: bench_toasters [--frames N] [--warmup N] [--seed N] [--threads N]
+ *                       [--renderer gdi|dib] [--res 1080p,1440p,4k,8k|WxH,...]
+ *                       [--counts 8,12,100,...] [--effects all|none|default]
+ *
+ * Author: Drift Johnson
+ * Repository: https://github.com/MushroomFleet/Flying-Toasters-JSX
+ */
+
+#define _CRT_SECURE_NO_WARNINGS     /* sscanf/strtok for the sweep lists */
+#define FT_BENCHMARK
+#include "flying_toasters.c"
+
+/* ============================================
+   BENCHMARK CONFIGURATION
+   ============================================ */
+
+#define BENCH_MAX_RES       16
+#define BENCH_MAX_COUNTS    16
+#define BENCH_DEFAULT_FRAMES 240
+#define BENCH_DEFAULT_WARMUP 30
+#define BENCH_DEFAULT_SEED  1984
+#define BENCH_DT            (1.0f / 60.0f)
+
+#define EFFECT_GLOW         0x1
+#define EFFECT_SCANLINES    0x2
+#define EFFECT_TRAILS       0x4
+#define EFFECT_ALL          0x8     /* sweep all 8 combinations */
+
+typedef struct {
+    const char* name;
+    int width, height;
+} BenchResolution;
+
+static const BenchResolution k_namedResolutions[] = {
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4k",    3840, 2160 },
+    { "8k",    7680, 4320 }
+};
+
+typedef struct {
+    int frames;
+    int warmup;
+    unsigned int seed;
+    int threads;
+    int renderer;
+    int effects;
+    BenchResolution res[BENCH_MAX_RES];
+    int resCount;
+    int counts[BENCH_MAX_COUNTS];
+    int countCount;
+} BenchOptions;
+
+/* ============================================
+   ARGUMENT PARSING
+   ============================================ */
+
+static BOOL parseResolution(const char* token, BenchResolution* out) {
+    int i, w, h;
+    
+    for (i = 0; i < (int)(sizeof(k_namedResolutions) / sizeof(k_namedResolutions[0])); i++) {
+        if (_stricmp(token, k_namedResolutions[i].name) == 0) {
+            *out = k_namedResolutions[i];
+            return TRUE;
+        }
+    }
+    
+    if (sscanf(token, "%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+        out->name = NULL;
+        out->width = w;
+        out->height = h;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static BOOL parseResolutionList(const char* list, BenchOptions* opt) {
+    char buf[256];
+    char* token;
+    
+    lstrcpynA(buf, list, sizeof(buf));
+    opt->resCount = 0;
+    for (token = strtok(buf, ","); token; token = strtok(NULL, ",")) {
+        if (opt->resCount >= BENCH_MAX_RES) break;
+        if (!parseResolution(token, &opt->res[opt->resCount])) {
+            fprintf(stderr, "bench_toasters: bad resolution '%s'\n", token);
+            return FALSE;
+        }
+        opt->resCount++;
+    }
+    return opt->resCount > 0;
+}
+
+static BOOL parseCountList(const char* list, BenchOptions* opt) {
+    char buf[256];
+    char* token;
+    
+    lstrcpynA(buf, list, sizeof(buf));
+    opt->countCount = 0;
+    for (token = strtok(buf, ","); token; token = strtok(NULL, ",")) {
+        int n = atoi(token);
+        if (opt->countCount >= BENCH_MAX_COUNTS) break;
+        if (n < 1) n = 1;
+        if (n > MAX_SWARM_TOASTERS) n = MAX_SWARM_TOASTERS;
+        opt->counts[opt->countCount++] = n;
+    }
+    return opt->countCount > 0;
+}
+
+static void usage(void) {
+    fputs("usage: bench_toasters [--frames N] [--warmup N] [--seed N] [--threads N]\n"
+          "                      [--renderer gdi|dib] [--res LIST] [--counts LIST]\n"
+          "                      [--effects all|none|default]\n", stderr);
+}
+
+static BOOL parseArgs(int argc, char** argv, BenchOptions* opt) {
+    static const int defaultCounts[] = { 8, 12, 100, 1000, 10000 };
+    int i;
+    
+    ZeroMemory(opt, sizeof(*opt));
+    opt->frames = BENCH_DEFAULT_FRAMES;
+    opt->warmup = BENCH_DEFAULT_WARMUP;
+    opt->seed = BENCH_DEFAULT_SEED;
+    opt->renderer = DEFAULT_RASTER;
+    opt->effects = EFFECT_ALL;
+    
+    opt->resCount = sizeof(k_namedResolutions) / sizeof(k_namedResolutions[0]);
+    memcpy(opt->res, k_namedResolutions, sizeof(k_namedResolutions));
+    opt->countCount = sizeof(defaultCounts) / sizeof(defaultCounts[0]);
+    memcpy(opt->counts, defaultCounts, sizeof(defaultCounts));
+    
+    for (i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+    
+        if (!val) {
+            usage();
+            return FALSE;
+        }
+    
+        if (strcmp(arg, "--frames") == 0) {
+            opt->frames = atoi(val);
+            if (opt->frames < 1) opt->frames = 1;
+        } else if (strcmp(arg, "--warmup") == 0) {
+            opt->warmup = atoi(val);
+            if (opt->warmup < 0) opt->warmup = 0;
+        } else if (strcmp(arg, "--seed") == 0) {
+            opt->seed = (unsigned int)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--threads") == 0) {
+            opt->threads = atoi(val);
+            if (opt->threads < 0) opt->threads = 0;
+            if (opt->threads > MAX_RENDER_THREADS) opt->threads = MAX_RENDER_THREADS;
+        } else if (strcmp(arg, "--renderer") == 0) {
+            opt->renderer = (_stricmp(val, "gdi") == 0) ? RASTER_GDI : RASTER_DIB;
+        } else if (strcmp(arg, "--res") == 0) {
+            if (!parseResolutionList(val, opt)) return FALSE;
+        } else if (strcmp(arg, "--counts") == 0) {
+            if (!parseCountList(val, opt)) return FALSE;
+        } else if (strcmp(arg, "--effects") == 0) {
+            if (_stricmp(val, "none") == 0) opt->effects = 0;
+            else if (_stricmp(val, "default") == 0) opt->effects = EFFECT_GLOW | EFFECT_SCANLINES | EFFECT_TRAILS;
+            else opt->effects = EFFECT_ALL;
+        } else {
+            usage();
+            return FALSE;
+        }
+        i++;
+    }
+    return TRUE;
+}
+
+/* ============================================
+   BENCHMARK RUN
+   ============================================ */
+
+/* Per-phase min/avg/p99 over every measured frame, not just the HUD window */
+static void summarizePhase(float* samples, int n, PhaseStats* out) {
+    float sum = 0.0f;
+    int i;
+    
+    qsort(samples, n, sizeof(float), compareFloat);
+    for (i = 0; i < n; i++) sum += samples[i];
+    
+    out->min = samples[0];
+    out->avg = sum / (float)n;
+    out->p99 = samples[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1];
+}
+
+static BOOL runCase(const BenchOptions* opt, const BenchResolution* res, int count,
+                    int effects, float* samples, BOOL first) {
+    Framebuffer present = { 0 };
+    Scene* scene = &g_scenes[0];
+    PhaseStats stats[PHASE_COUNT];
+    LONGLONG start, end;
+    int frame, p, threads;
+    double seconds;
+    
+    /* Settings as loadSettings would leave them; createRenderer may override */
+    g_toasterCount = count;
+    g_perMonitor = FALSE;
+    g_adaptiveQuality = FALSE;
+    g_rasterBackend = opt->renderer;
+    g_renderThreads = opt->threads;
+    g_showGlow = (effects & EFFECT_GLOW) != 0;
+    g_showScanlines = (effects & EFFECT_SCANLINES) != 0;
+    g_showTrails = (effects & EFFECT_TRAILS) != 0;
+    g_showStats = FALSE;
+    g_profileCsvPath[0] = '\0';
+    g_seed = opt->seed;
+    
+    /* Startup is timed from here to the first (warmup) frame's present */
+    g_startTime = qpcNow();
+    if (!createRenderer(NULL, NULL, res->width, res->height) ||
+        !createFramebuffer(&present, NULL, res->width, res->height)) {
+        fprintf(stderr, "bench_toasters: out of memory at %dx%d, %d toasters\n",
+                res->width, res->height, count);
+        destroyFramebuffer(&present);
+        destroyRenderer();
+        return FALSE;
+    }
+    
+    for (frame = 0; frame < opt->warmup; frame++) {
+        renderFrame(scene, present.dc, BENCH_DT);
+    }
+    GdiFlush();
+    
+    start = qpcNow();
+    for (frame = 0; frame < opt->frames; frame++) {
+        int last;
+    
+        renderFrame(scene, present.dc, BENCH_DT);
+    
+        last = (scene->profiler.historyPos + PROFILE_WINDOW - 1) % PROFILE_WINDOW;
+        for (p = 0; p < PHASE_COUNT; p++) {
+            samples[p * opt->frames + frame] = scene->profiler.history[p][last];
+        }
+    }
+    GdiFlush();
+    end = qpcNow();
+    seconds = (double)(end - start) / (double)scene->profiler.frequency;
+    
+    for (p = 0; p < PHASE_COUNT; p++) {
+        summarizePhase(samples + p * opt->frames, opt->frames, &stats[p]);
+    }
+    
+    threads = (g_rasterBackend == RASTER_DIB && scene->pool.startSemaphore) ? scene->pool.workerCount + 1 : 1;
+    
+    /* Report what actually ran, after the swarm overrides */
+    printf("%s    {\n", first ? "" : ",\n");
+    printf("      \"width\": %d, \"height\": %d, \"toasters\": %d,\n",
+           res->width, res->height, scene->flock.count);
+    printf("      \"renderer\": \"%s\", \"threads\": %d,\n",
+           g_rasterBackend == RASTER_DIB ? "dib" : "gdi", threads);
+    printf("      \"glow\": %s, \"scanlines\": %s, \"trails\": %s,\n",
+           g_showGlow ? "true" : "false", g_showScanlines ? "true" : "false",
+           g_showTrails ? "true" : "false");
+    printf("      \"frames\": %d, \"fps\": %.2f, \"startup_ms\": %.4f,\n", opt->frames,
+           seconds > 0.0 ? (double)opt->frames / seconds : 0.0, scene->profiler.startupMs);
+    printf("      \"phases_ms\": {");
+    for (p = 0; p < PHASE_COUNT; p++) {
+        printf("%s\n        \"%s\": { \"min\": %.4f, \"avg\": %.4f, \"p99\": %.4f }",
+               p ? "," : "", k_phaseNames[p], stats[p].min, stats[p].avg, stats[p].p99);
+    }
+    printf("\n      }\n    }");
+    fflush(stdout);
+    
+    destroyFramebuffer(&present);
+    destroyRenderer();
+    return TRUE;
+}
+
+int main(int argc, char** argv) {
+    BenchOptions opt;
+    float* samples;
+    int r, c, e;
+    BOOL first = TRUE;
+    
+    if (!parseArgs(argc, argv, &opt)) return 2;
+    
+    samples = (float*)malloc(sizeof(float) * PHASE_COUNT * opt.frames);
+    if (!samples) return 1;
+    
+    printf("{\n  \"seed\": %u, \"warmup\": %d,\n  \"results\": [\n", opt.seed, opt.warmup);
+    
+    for (r = 0; r < opt.resCount; r++) {
+        for (c = 0; c < opt.countCount; c++) {
+            int firstEffect = (opt.effects & EFFECT_ALL) ? 0 : opt.effects;
+            int lastEffect = (opt.effects & EFFECT_ALL) ? 7 : opt.effects;
+    
+            for (e = firstEffect; e <= lastEffect; e++) {
+                if (runCase(&opt, &opt.res[r], opt.counts[c], e, samples, first)) first = FALSE;
+            }
+        }
+    }
+    
+    printf("\n  ]\n}\n");
+    free(samples);
+    return 0;
+}
@@ -8,6 +8,7 @@ REM Usage:
 REM   build_msvc.bat          - Build the screensaver
 REM   build_msvc.bat clean    - Remove build artifacts
 REM   build_msvc.bat install  - Copy to Windows directory (admin required)
+REM   build_msvc.bat bench    - Build the headless renderer benchmark
 
 setlocal
 
@@ -17,6 +18,7 @@ set RESOURCE=flying_toasters.rc
 
 if "%1"=="clean" goto clean
 if "%1"=="install" goto install
+if "%1"=="bench" goto bench
 
 REM Check for cl.exe
 where cl >nul 2>nul
@@ -41,7 +43,7 @@ REM Compile and link
 echo Compiling and linking...
 cl /nologo /O2 /W3 /DUNICODE /D_UNICODE %SOURCE% flying_toasters.res ^
    /link /OUT:%TARGET% ^
-   user32.lib gdi32.lib advapi32.lib comctl32.lib scrnsavw.lib
+   user32.lib gdi32.lib advapi32.lib comctl32.lib dwmapi.lib scrnsavw.lib
 
 if %ERRORLEVEL% neq 0 (
     echo Compilation failed.
@@ -58,7 +60,7 @@ goto end
 
 :clean
 echo Cleaning build artifacts...
-del /q *.obj *.res %TARGET% 2>nul
+del /q *.obj *.res %TARGET% bench_toasters.exe 2>nul
 echo Done.
 goto end
 
@@ -79,5 +81,27 @@ echo Open Settings ^> Personalization ^> Lock screen ^> Screen saver settings
 echo and select "Flying Toasters - SVGA Wireframe"
 goto end
 
+:bench
+where cl >nul 2>nul
+if %ERRORLEVEL% neq 0 (
+    echo Error: cl.exe not found.
+    echo Please run this from a Visual Studio Developer Command Prompt
+    echo or run vcvarsall.bat first.
+    exit /b 1
+)
+echo Building renderer benchmark...
+cl /nologo /O2 /W3 /DUNICODE /D_UNICODE bench_toasters.c ^
+   /link /SUBSYSTEM:CONSOLE /OUT:bench_toasters.exe ^
+   user32.lib gdi32.lib advapi32.lib
+if %ERRORLEVEL% neq 0 (
+    echo Compilation failed.
+    exit /b 1
+)
+echo.
+echo Build successful: bench_toasters.exe
+echo Results are printed to stdout as JSON, e.g.
+echo   bench_toasters.exe --res 4k --counts 8,10000 ^> results.json
+goto end
+
 :end
 endlocal
@@ -5,38 +5,170 @@
  * A tribute to Berkeley Systems' After Dark Flying Toasters
  * Rendered in vertex-shaded wireframe style
  *
- * Build: cl /O2 flying_toasters.c /link user32.lib gdi32.lib /OUT:flying_toasters.scr
+ * Build: cl /O2 flying_toasters.c /link user32.lib gdi32.lib advapi32.lib comctl32.lib
+ *        dwmapi.lib scrnsavw.lib /OUT:flying_toasters.scr
  * Or use the provided Makefile with MinGW
  *
+ * Defining FT_BENCHMARK compiles only the renderer (everything up to
+ * FRAME PACING); bench_toasters.c includes this file that way.
+ *
  * Author: Drift Johnson
  * Repository: https://github.com/MushroomFleet/Flying-Toasters-JSX
  */
 
 #define WIN32_LEAN_AND_MEAN
+#ifndef _CRT_SECURE_NO_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS     /* fopen for the profiler CSV */
+#endif
 #define _USE_MATH_DEFINES
+#define COBJMACROS
 
 #include <windows.h>
+#include <commctrl.h>
 #include <math.h>
+#include <float.h>
+#include <malloc.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <initguid.h>   /* defines the D3D/DXGI IIDs here; no dxguid.lib */
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#ifndef FT_BENCHMARK
 #include <scrnsave.h>
+#include <dwmapi.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSFORM_LANES     8
+#elif defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORM_LANES     4
+#else
+#define TRANSFORM_LANES     1
+#endif
 
 /* ============================================
    CONFIGURATION
    ============================================ */
 
-#define MAX_TOASTERS        12
+#define MAX_TOASTERS        12      /* Classic mode slider limit */
+#define MAX_SWARM_TOASTERS  10000   /* Large-flock ("swarm") mode limit */
 #define DEFAULT_TOASTERS    8
+#define RNG_LANES           4       /* interleaved xoshiro128+ streams per Rng */
+#define RESPAWN_DRAWS       12      /* resetToaster's 11 randoms, rounded to RNG_LANES */
+#define SPAWN_Z_MIN         200.0f  /* toasters spawn, and stay, at z in [min, min + range) */
+#define SPAWN_Z_RANGE       400.0f
+#define DEPTH_BUCKETS       1024    /* spawn z slices in the persistent depth index */
 #define TIMER_ID            1
-#define FRAME_INTERVAL      16  /* ~60 FPS */
+#define FRAME_INTERVAL      16  /* ~60 FPS, WM_TIMER fallback only */
+
+/* Frame pacing */
+#define DEFAULT_TARGET_FPS  60
+#define MAX_TARGET_FPS      480
+#define SIM_TICK_RATE       60.0f   /* Flight speeds are tuned per 60 Hz tick */
+#define MAX_FRAME_DT        0.1f    /* Clamp simulation steps after stalls */
+#define POWER_SAVER_FPS     15      /* Frame-rate ceiling on battery or energy saver */
+#define DISPLAY_OFF_POLL_MS 250     /* Paused render threads still notice quit */
+#define PREVIEW_FPS         15      /* The /p thumbnail in Display settings */
+#define PREVIEW_MAX_WIDTH   320     /* Narrower saver windows are previews too */
+#define REMOTE_FPS          20      /* Frame-rate ceiling in RDP / Citrix sessions */
+#define REMOTE_COLOR_MASK   0xF0F0F0    /* 4 bits a channel, for the remoting codec */
+#define PRESENT_LATENCY_RING 8      /* flip-model presents awaiting their frame statistics */
+
+/* Windows 10 1803+; older SDK headers don't define it */
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+/* Scanlines: every Nth row darkened by a percentage (100 = black) */
+#define DEFAULT_SCANLINE_SPACING    3
+#define MAX_SCANLINE_SPACING        16
+#define DEFAULT_SCANLINE_INTENSITY  100
+
+/* Trails: brightness above the background kept per 60 Hz tick */
+#define TRAIL_DECAY         0.85f
+#define TRAIL_SETTLE_TICKS  40.0f   /* 255 * 0.85^40 < 1: the band is background again */
 
 #define FOV                 400.0f
 #define MAX_VERTICES        128
 #define MAX_EDGES           128
 
+/* Batched transform layout: body + two wings, each padded to a SIMD multiple */
+#define MESH_PART_BODY          0
+#define MESH_PART_LEFT_WING     1
+#define MESH_PART_RIGHT_WING    2
+#define MESH_PART_COUNT         3
+#define MESH_PART_STRIDE        24
+#define MESH_BATCH_STRIDE       (MESH_PART_COUNT * MESH_PART_STRIDE)
+
+/* Mesh levels of detail, finest first (see k_meshLods) */
+#define LOD_LEVELS          4
+#define LOD_GPU             1       /* the GPU backend instances one level for the whole flock */
+#define LOD_PREVIEW         2       /* finest level the /p thumbnail draws */
+
+/* Baked flap poses per wingPhase period (a power of two): a new pose every frame at 144 Hz */
+#define WING_KEYFRAMES          128
+
+/* Raster backends */
+#define RASTER_GDI          0   /* Per-pixel GDI LineTo (legacy) */
+#define RASTER_DIB          1   /* Direct stores into the DIB section */
+#define RASTER_GPU          2   /* Direct3D 11, falls back to DEFAULT_RASTER */
+#define DEFAULT_RASTER      RASTER_DIB
+
+/* Per-monitor mode */
+#define MAX_MONITORS        16
+
+/* Tiled rasterizer */
+#define MAX_RENDER_THREADS  64
+#define MIN_BAND_HEIGHT     16
+#define BANDS_PER_THREAD    8
+
+/* Frame profiler */
+#define PROFILE_WINDOW      240     /* Frames of history behind min/avg/p99 */
+#define PROFILE_STATS_EVERY 30      /* Frames between stats refreshes */
+#define HUD_WIDTH           384     /* drawProfilerHud's extent, ANSI_FIXED_FONT */
+#define HUD_HEIGHT          (8 + 14 * (PHASE_COUNT + 4))
+
+/* Dirty rectangles (trails off): past these, clear and present everything */
+#define MAX_DIRTY_RECTS     64
+#define DIRTY_MERGE_SLACK   16      /* rects this close merge; fewer, larger blits */
+#define DIRTY_FULL_PERCENT  60      /* of the screen */
+
+/* Adaptive quality: frame work as a percentage of the frame interval */
+#define QUALITY_WINDOW          30      /* frames averaged per decision */
+#define QUALITY_LOWER_PERCENT   90      /* above this, step quality down */
+#define QUALITY_RAISE_PERCENT   55      /* below this for a while, step back up */
+#define QUALITY_RAISE_WINDOWS   4       /* calm windows before stepping up */
+#define QUALITY_MAX_RAISE_WINDOWS 64    /* backoff cap after failed step-ups */
+
+/*
+ * GDI object cache: colours are quantized to 8 levels per channel, so a
+ * full cache is 512 colours x MAX_LINE_WIDTH pens = 2048 handles, well
+ * under the default quota of 10,000 per process.
+ */
+#define CACHE_COLOR_STEP    36
+#define CACHE_COLOR_LEVELS  8
+#define CACHE_COLOR_COUNT   (CACHE_COLOR_LEVELS * CACHE_COLOR_LEVELS * CACHE_COLOR_LEVELS)
+#define MAX_LINE_WIDTH      4
+#define LINE_COORD_LIMIT    1048576.0f  /* sub-pixel endpoints are clamped to +-this */
+
+/* Glow sprites */
+#define GLOW_MIN_RADIUS     2
+#define GLOW_MAX_RADIUS     20
+#define GLOW_CORNERS        4       /* Front-face corners; all vertices is optional */
+
+/* Baked lighting: shading is a fetch from (N.L, height) tables */
+#define LIGHT_NDOTL_STEPS   64
+#define LIGHT_HEIGHT_STEPS  64
+
 /* Registry key for settings */
 #define REG_KEY             "Software\\FlyingToastersScr"
 
+#define STRINGIFY_(x)       #x
+#define STRINGIFY(x)        STRINGIFY_(x)
+
 /* ============================================
    TYPE DEFINITIONS
    ============================================ */
@@ -54,6 +186,7 @@ typedef struct {
     Edge edges[MAX_EDGES];
     int vertexCount;
     int edgeCount;
+    int coreEdgeCount;  /* edges past this are detail the governor may drop */
 } Model;
 
 typedef struct {
@@ -65,65 +198,553 @@ typedef struct {
     float scale;
 } ProjectedPoint;
 
+/* 32-bit top-down back buffer; pixels are 0x00RRGGBB */
+typedef struct {
+    HDC dc;
+    HBITMAP bitmap;
+    HBITMAP oldBitmap;
+    DWORD* pixels;
+    int width, height;
+    int pitch;          /* in pixels */
+} Framebuffer;
+
+/* Row-major affine transform: rows are (m[0..3]), (m[4..7]), (m[8..11]) */
+typedef struct {
+    float m[12];
+} Mat34;
+
+/* Shared mesh vertices in SoA form for the transform kernel */
+typedef struct {
+    DECLSPEC_ALIGN(32) float x[MESH_BATCH_STRIDE];
+    DECLSPEC_ALIGN(32) float y[MESH_BATCH_STRIDE];
+    DECLSPEC_ALIGN(32) float z[MESH_BATCH_STRIDE];
+    int partVertexCount[MESH_PART_COUNT];
+} MeshSoA;
+
+/* What one level of detail puts in the shared meshes */
+typedef struct {
+    float minPixels;    /* drawn while a model unit spans at least this many back buffer pixels */
+    BOOL rounded;       /* body top corners chamfered off */
+    BOOL slots;
+    BOOL lever;
+    int wingSegments;   /* a wing has 4 (n + 1) vertices, at most MESH_PART_STRIDE */
+} MeshLodSpec;
+
+/*
+ * One level of detail: its models, and their vertices packed for
+ * transformPart. `edges` joins all three parts into one list of
+ * toaster-relative indices (part * MESH_PART_STRIDE + vertex), each
+ * edge once, with the wing bracing last so [0, coreEdgeCount) is the
+ * reduced-quality set. Every backend submits a toaster from it.
+ */
 typedef struct {
-    float x, y, z;
-    float speed;
-    float wobble;
-    float wobbleSpeed;
-    float wingPhase;
-    float wingSpeed;
-    float rotX, rotY;
-    float scale;
     Model body;
-    Model leftWing;
-    Model rightWing;
-} FlyingToaster;
+    Model wings[2];     /* [0] = left, [1] = right */
+    MeshSoA soa;
+    Edge edges[MESH_PART_COUNT * MAX_EDGES];
+    int edgeCount;
+    int coreEdgeCount;
+} MeshLod;
+
+/* A toaster's projected extent; minX > maxX when nothing is in front of the eye */
+typedef struct {
+    float minX, minY, maxX, maxY;
+} ScreenBounds;
+
+/*
+ * Per-frame output of the transform stage for the whole flock.
+ * Toaster t owns vertices [t * MESH_BATCH_STRIDE, (t + 1) * MESH_BATCH_STRIDE).
+ */
+typedef struct {
+    int capacity;       /* in toasters */
+    Mat34* matrices;    /* capacity * MESH_PART_COUNT */
+    float* viewX;
+    float* viewY;
+    float* viewZ;
+    float* screenX;
+    float* screenY;
+    float* screenZ;
+    float* screenScale;
+    int* valid;         /* non-zero when in front of the eye */
+    Color* colors;
+    ScreenBounds* bounds;   /* per toaster, over its valid vertices */
+    BYTE* lod;          /* per toaster, its g_meshLods level */
+    void* block;
+} VertexBatch;
+
+/*
+ * Shade colours sampled over N.L (rows) and height blend (columns), and
+ * the wing colours, whose flat normal leaves height as the only input.
+ * Rebuilt only when the light direction they were baked for changes.
+ */
+typedef struct {
+    Vec3 lightDir;
+    BOOL built;
+    Color body[LIGHT_NDOTL_STEPS * LIGHT_HEIGHT_STEPS];
+    Color wing[LIGHT_HEIGHT_STEPS];
+} LightingTables;
+
+/* Timed phases of renderFrame */
+typedef enum {
+    PHASE_CLEAR,
+    PHASE_UPDATE,
+    PHASE_SORT,
+    PHASE_TRANSFORM,
+    PHASE_RASTER,
+    PHASE_GLOW,
+    PHASE_SCANLINES,
+    PHASE_PRESENT,
+    PHASE_FRAME,        /* Whole renderFrame, HUD included */
+    PHASE_COUNT
+} FramePhase;
+
+typedef struct {
+    float min, avg, p99;    /* milliseconds */
+} PhaseStats;
+
+/* What the power notifications allow; published by the UI thread */
+typedef enum {
+    POWER_NORMAL,
+    POWER_SAVER,        /* battery or energy saver: low frame rate and resolution */
+    POWER_DISPLAY_OFF,  /* nothing to draw for: render threads pause */
+    POWER_STATE_COUNT
+} PowerState;
+
+/* How a frame reaches the screen */
+typedef enum {
+    PRESENT_BLIT,       /* the whole back buffer, every frame */
+    PRESENT_DIRTY,      /* only the rects the frame changed */
+    PRESENT_FLIP,       /* flip-model swap chain, handed to DWM */
+    PRESENT_PATH_COUNT
+} PresentPath;
+
+/*
+ * Rolling per-phase timings. Begin/end pairs stamp QueryPerformanceCounter;
+ * stats are recomputed every PROFILE_STATS_EVERY frames from the last
+ * PROFILE_WINDOW frames. Optionally appends one CSV row per frame.
+ *
+ * Frame work over wall time (pauses included) is the render thread's
+ * busy share, the counter to compare across power states: CPU and GPU
+ * power track it far more closely than the frame rate does.
+ */
+typedef struct {
+    LONGLONG frequency;
+    LONGLONG started[PHASE_COUNT];
+    LONGLONG lastFrameEnd;
+    float current[PHASE_COUNT];
+    float history[PHASE_COUNT][PROFILE_WINDOW];
+    float interval[PROFILE_WINDOW];     /* end to end of consecutive frames, ms */
+    int historyPos;
+    int historyCount;
+    PhaseStats stats[PHASE_COUNT];
+    float busyPercent;
+    float startupMs;    /* g_startTime to the first visible present, 0 until then */
+    PowerState power;   /* as of the last frame */
+    
+    /* Set by the present step each frame; latency < 0 means not measured */
+    PresentPath present;
+    float presentKB;    /* window pixels sent, 32 bpp, before any remoting compression */
+    float presentLatency;   /* Present to vblank, ms: flip model only */
+    float sentKB[PROFILE_WINDOW];
+    float latency[PROFILE_WINDOW];
+    float bandwidth;    /* MB/s over the window */
+    PhaseStats latencyStats;
+    int latencyCount;   /* measured frames behind latencyStats, 0 = n/a */
+    DWORD frameIndex;
+    FILE* csv;
+} FrameProfiler;
+
+typedef struct Scene Scene;
+
+/* Dedicated render thread paced by QueryPerformanceCounter */
+typedef struct {
+    HWND hWnd;
+    Scene* scene;
+    HANDLE thread;
+    HANDLE timer;
+    BOOL highResTimer;
+    volatile LONG quit;
+    LONGLONG frequency;
+} FrameLoop;
+
+/* An edge queued for the tiled rasterizer: absolute VertexBatch indices */
+typedef struct {
+    int v1, v2;
+} RasterEdge;
+
+/* One toaster's queued items, and the bands its whole footprint reaches */
+typedef struct {
+    int start, end;
+    int firstBand, lastBand;
+} BinRun;
+
+/*
+ * The frame's visible edges in back-to-front order, plus a per-band index
+ * list (counting-sort layout: band b owns bandEdges[bandStart[b] ..
+ * bandStart[b + 1])). Order within a band is preserved, so painter's
+ * ordering still holds inside every band. Edges are queued in one run
+ * per toaster; a run whose footprint fits one band is bucketed whole.
+ */
+typedef struct {
+    RasterEdge* edges;
+    int edgeCount;
+    int edgeCapacity;
+    BinRun* runs;
+    int runCount;
+    int runCapacity;
+    int* bandEdges;
+    int bandEdgeCapacity;
+    int* bandStart;
+    int* bandFill;
+    float* bandAge;     /* ticks since anything was drawn in the band (trails) */
+    int bandCapacity;
+    int bandCount;
+    int bandHeight;
+    int pad;            /* rows an item can reach past its endpoints */
+} EdgeBins;
+
+/* One constant-pen stretch of a GDI line, `from` inclusive, `to` exclusive like LineTo */
+typedef struct {
+    POINT from, to;
+    int key;            /* quantizeColor */
+    int width;
+} GdiRun;
+
+/*
+ * A toaster's GDI lines, gathered before any are drawn so each pen is
+ * selected once and all its runs go out in one PolyPolyline.
+ */
+typedef struct {
+    GdiRun* runs;
+    int runCount;
+    int runCapacity;
+    POINT* points;      /* the runs as two-point polylines, grouped by pen */
+    int pointCapacity;
+    DWORD* counts;
+    int countCapacity;
+} GdiLineBatch;
+
+/*
+ * The parts of the back buffer a frame touched, as disjoint-ish rects in
+ * pixels. `full` covers the entire surface and ignores the list.
+ */
+typedef struct {
+    RECT rects[MAX_DIRTY_RECTS];
+    int count;
+    BOOL full;
+} DirtyRegion;
+
+/* One pass of band work handed to the render pool */
+typedef enum {
+    TILE_PASS_CLEAR,
+    TILE_PASS_RASTER,
+    TILE_PASS_GLOW,
+    TILE_PASS_SCANLINES
+} TilePass;
+
+typedef struct {
+    TilePass pass;
+    Framebuffer* fb;
+    const VertexBatch* batch;
+    const EdgeBins* bins;
+    DWORD clearColor;
+    int decay;          /* clear pass: 0 clears, else trail fade in 1/256ths */
+    const DirtyRegion* dirty;   /* clear/scanline passes: only these rects, NULL = all */
+    int scanlineSpacing;
+    int scanlineKeep;   /* brightness left on a scanline row, in 1/256ths */
+    int maxLineWidth;   /* raster pass */
+} TileJob;
+
+/*
+ * Persistent worker threads. The UI thread also takes bands, so a pool
+ * of N render threads owns N - 1 workers.
+ */
+typedef struct {
+    HANDLE threads[MAX_RENDER_THREADS];
+    int workerCount;
+    HANDLE startSemaphore;
+    HANDLE doneEvent;
+    volatile LONG nextBand;
+    volatile LONG pending;
+    volatile LONG quit;
+    const TileJob* job;
+} RenderPool;
+
+/*
+ * Additive radial glow sprites, one per radius. A texel adds
+ * (channel * tint >> 16) + white to each channel, which works out to
+ * lerp(colour, white, f) * 0.3 * f for the texel's falloff f.
+ */
+typedef struct {
+    WORD tint;
+    WORD white;
+} GlowTexel;
+
+typedef struct {
+    GlowTexel* texels;
+    int offset[GLOW_MAX_RADIUS + 1];    /* radius r: (2r + 1)^2 texels at offset[r] */
+} GlowAtlas;
+
+/* One toaster part as the GPU vertex shader reads it: four float4 rows */
+typedef struct {
+    Mat34 matrix;
+    float centerX, centerY;
+    float pad[2];
+} GpuInstance;
+
+/*
+ * Direct3D 11 device and the flock's GPU resources. d3d11.dll and the
+ * shader compiler are loaded at runtime so the .scr still starts on
+ * machines without them.
+ */
+typedef struct {
+    HMODULE d3d11;
+    HMODULE compiler;
+    pD3DCompile compile;
+    ID3D11Device* device;
+    ID3D11DeviceContext* context;
+    IDXGISwapChain* swapChain;
+    ID3D11RenderTargetView* target;
+    ID3D11Buffer* meshBuffer;       /* MESH_BATCH_STRIDE float4 positions */
+    ID3D11Buffer* edgeBuffer;       /* uint4 (v1, v2, part, 0) for every part */
+    ID3D11Buffer* instanceBuffer;   /* capacity * MESH_PART_COUNT GpuInstances */
+    ID3D11Buffer* constants;
+    ID3D11Buffer* glowBuffer;       /* uint4 (vertex, part, 0, 0) per glow point */
+    ID3D11ShaderResourceView* views[4];
+    ID3D11VertexShader* lineVS;
+    ID3D11VertexShader* glowVS;
+    ID3D11VertexShader* screenVS;
+    ID3D11PixelShader* linePS;
+    ID3D11PixelShader* glowPS;
+    ID3D11PixelShader* scanlinePS;
+    ID3D11PixelShader* fadePS;
+    ID3D11PixelShader* backgroundPS;
+    ID3D11BlendState* additive;
+    ID3D11BlendState* fade;
+    ID3D11BlendState* fadeFloor;
+    ID3D11BlendState* darken;
+    ID3D11RasterizerState* raster;
+    int edgeCount;
+    int coreEdgeCount;  /* edges drawn without wing cross-bracing */
+    int glowCount;      /* glow points per toaster */
+    int capacity;
+    int width, height;  /* swap chain buffers; DXGI stretches them to the window */
+    float pixelScale;   /* back buffer pixels per window pixel */
+    BOOL primed;        /* back buffer holds a frame trails can fade */
+    
+    /*
+     * Flip model: flipped buffers do not keep the last frame, so drawing
+     * goes to `canvas` (which does, for trails) and is copied into the
+     * back buffer just before the HUD and Present.
+     */
+    BOOL flip;
+    ID3D11Texture2D* canvas;
+    BOOL resolved;      /* canvas already copied this frame */
+    UINT submittedId[PRESENT_LATENCY_RING];
+    LONGLONG submitted[PRESENT_LATENCY_RING];   /* QPC at Present, by present count */
+} GpuRenderer;
+
+/*
+ * Pens and brushes that live for the whole ScreenSaverProc session.
+ * Colour entries are created on first use and then reused every frame,
+ * so once the palette has been seen a frame allocates no GDI handles.
+ */
+typedef struct {
+    HPEN pens[MAX_LINE_WIDTH][CACHE_COLOR_COUNT];
+    HBRUSH clearBrush;
+} GdiCache;
+
+/*
+ * RNG_LANES interleaved xoshiro128+ generators, stored word-major so a
+ * single SSE2 register steps every lane. Each flock owns one, so scenes
+ * on different frame threads never share state.
+ */
+typedef struct {
+    DECLSPEC_ALIGN(16) unsigned int s[4][RNG_LANES];
+} Rng;
+
+/*
+ * Flock instance state, structure-of-arrays so updateToasters streams
+ * through contiguous floats. Every array holds `capacity` entries and
+ * lives in one aligned allocation.
+ */
+typedef struct {
+    int count;          /* toasters drawn; the quality governor may lower it */
+    int total;          /* toasters initialised */
+    int capacity;
+    float sizeScale;    /* < 1 in swarm mode so big flocks stay legible */
+    float width, height;    /* flight area: the scene's back buffer */
+    
+    /* Advanced every frame by updateToasters */
+    float* x;
+    float* y;
+    float* wobble;
+    float* wingPhase;
+    float* speed;
+    float* wobbleSpeed;
+    float* wingSpeed;
+    
+    /* Only change on respawn */
+    float* z;
+    float* rotX;
+    float* rotY;
+    float* scale;
+    
+    /*
+     * Depth index: z only changes on respawn, so the far-to-near order is
+     * kept up to date there rather than re-sorted every frame. Each z slice
+     * is a list sorted far to near, ties by index, like a full sort.
+     */
+    int* depthBucket;   /* slice holding each toaster, -1 before its first spawn */
+    int* depthNext;     /* nearer neighbour in the slice, -1 at the end */
+    int* depthPrev;     /* farther neighbour, -1 at the slice head */
+    int depthHead[DEPTH_BUCKETS];   /* farthest toaster per slice, -1 when empty */
+    
+    Rng rng;            /* respawn randoms, seeded per scene */
+    void* block;
+} ToasterFlock;
+
+#define FLOCK_FIELD_COUNT   14  /* 11 float arrays, then the three index arrays */
+
+/* The power settings as last notified; UI thread only */
+typedef struct {
+    BOOL onBattery;
+    BOOL energySaver;
+    BOOL displayOff;
+    HPOWERNOTIFY notify[3];
+} PowerMonitor;
+
+/* Depth-ordered key; the order lists these, not the toasters */
+typedef struct {
+    float z;
+    int index;
+} DepthKey;
+
+/* One step of the adaptive quality ladder; each is cheaper than the last */
+typedef struct {
+    BOOL glow;
+    BOOL bracing;       /* wing cross-bracing edges */
+    int maxLineWidth;
+    int countPercent;   /* of the configured flock */
+    int scaleNum, scaleDen;     /* back buffer resolution, as a fraction of the window */
+} QualityLevel;
+
+/*
+ * Frame-time governor. Decisions are made once per QUALITY_WINDOW frames;
+ * stepping up needs several calm windows, and that wait doubles whenever
+ * a step up is undone straight away, so a load that sits between two
+ * levels settles on the cheaper one instead of oscillating.
+ */
+typedef struct {
+    int level;          /* index into k_qualityLevels, 0 = full quality */
+    int windowFrames;
+    float windowMs;
+    int calmWindows;
+    int raiseAfter;     /* calm windows needed before stepping up */
+    int sinceRaise;     /* windows since the last step up */
+} QualityGovernor;
+
+/*
+ * One back buffer and everything that renders into it. Normally the saver
+ * window is a single scene; per-monitor mode gives each monitor its own,
+ * with its own flock, band workers and render thread, placed at `origin`
+ * in the window's client area.
+ */
+struct Scene {
+    POINT origin;
+    int width, height;
+    int refreshHz;      /* monitor refresh for per-monitor vsync, 0 = unknown */
+    ToasterFlock flock;
+    DepthKey* cullOrder;    /* on-screen toasters in flock order, for the transform */
+    DepthKey* depthOrder;   /* the same toasters far to near, for drawing */
+    BYTE* onScreen;         /* per toaster, set by cullFlock */
+    VertexBatch batch;
+    Framebuffer fb;
+    EdgeBins bins;
+    EdgeBins glowBins;
+    GdiLineBatch lines; /* RASTER_GDI only */
+    RenderPool pool;
+    DirtyRegion dirty;  /* drawn last frame */
+    int scaleNum, scaleDen;     /* back buffer pixels per window pixel */
+    QualityGovernor quality;
+    GpuRenderer gpu;
+    FrameProfiler profiler;
+    FrameLoop loop;
+    HWND hWnd;              /* saver window, NULL when rendering offscreen */
+    CRITICAL_SECTION presentLock;   /* held for a frame; WM_PAINT presents under it */
+    volatile LONG repaint;  /* set by WM_PAINT: present the whole back buffer next frame */
+};
 
 /* ============================================
    GLOBAL STATE
    ============================================ */
 
-static FlyingToaster g_toasters[MAX_TOASTERS];
+static Scene g_scenes[MAX_MONITORS];
+static int g_sceneCount = 0;
+static BOOL g_perMonitor = FALSE;
 static int g_toasterCount = DEFAULT_TOASTERS;
-static int g_screenWidth = 0;
-static int g_screenHeight = 0;
-static HDC g_memDC = NULL;
-static HBITMAP g_memBitmap = NULL;
-static HBITMAP g_oldBitmap = NULL;
+static unsigned int g_seed = 0;     /* flock seed; 0 picks a new one every run */
+static BOOL g_swarmMode = FALSE;
+static int g_rasterBackend = DEFAULT_RASTER;
+static GdiCache g_gdi = { 0 };
 static BOOL g_showScanlines = TRUE;
+static int g_scanlineSpacing = DEFAULT_SCANLINE_SPACING;
+static int g_scanlineIntensity = DEFAULT_SCANLINE_INTENSITY;
 static BOOL g_showGlow = TRUE;
 static BOOL g_showTrails = TRUE;
+static int g_renderScale = 100;     /* back buffer percent of the window, see k_renderScales */
+static BOOL g_adaptiveQuality = FALSE;
+static BOOL g_powerAware = TRUE;
+static volatile LONG g_powerState = POWER_NORMAL;
+static PowerMonitor g_power = { 0 };
+static HANDLE g_displayOnEvent = NULL;  /* manual reset; clear while the display is off */
+static UINT g_timerInterval = 0;        /* WM_TIMER fallback period, 0 = frame loops run */
+static LONGLONG g_startTime = 0;        /* QPC at WM_CREATE, for the startup time; 0 = not timed */
+static BOOL g_preview = FALSE;          /* drawing the /p thumbnail, see applyPreviewSettings */
+static BOOL g_remoteAware = TRUE;
+static BOOL g_remoteSession = FALSE;    /* RDP / Citrix, see applyRemoteSettings */
+static BOOL g_composited = FALSE;       /* DWM composes the desktop: flip model is available */
+
+/* Shared read-only meshes, built once by createToasterModels */
+static MeshLod g_meshLods[LOD_LEVELS];
+static float g_meshRadius = 0.0f;   /* bounding sphere about the origin, at any flap angle or level */
+static BOOL g_modelsBuilt = FALSE;
+static int g_finestLod = 0;         /* no toaster is drawn finer than this level */
+static GlowAtlas g_glowAtlas = { 0 };
+static BOOL g_glowAllVertices = FALSE;
+static int g_renderThreads = 0;     /* 0 = one per physical core */
+static BOOL g_showStats = FALSE;
+static char g_profileCsvPath[MAX_PATH] = "";
+static int g_targetFps = DEFAULT_TARGET_FPS;    /* 0 = uncapped */
+static BOOL g_vsync = FALSE;
 
 /* Light direction (normalized) */
 static Vec3 g_lightDir = { 0.408f, 0.816f, 0.408f };
+static LightingTables g_lighting = { 0 };
+
+/* Flap matrices for the left and right wing, one pair per keyframe */
+static Mat34 g_wingKeyframes[WING_KEYFRAMES][2];
+static BOOL g_wingKeyframesBuilt = FALSE;
 
 /* ============================================
    VECTOR MATH
    ============================================ */
 
-static Vec3 vec3_add(Vec3 a, Vec3 b) {
-    Vec3 r = { a.x + b.x, a.y + b.y, a.z + b.z };
-    return r;
+static float vec3_dot(Vec3 a, Vec3 b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
-static Vec3 vec3_sub(Vec3 a, Vec3 b) {
-    Vec3 r = { a.x - b.x, a.y - b.y, a.z - b.z };
-    return r;
+static float vec3_length(Vec3 v) {
+    return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
 }
 
+/* only the scalar lighting fallback needs per-vertex normals */
+#if TRANSFORM_LANES == 1
 static Vec3 vec3_scale(Vec3 v, float s) {
     Vec3 r = { v.x * s, v.y * s, v.z * s };
     return r;
 }
 
-static float vec3_dot(Vec3 a, Vec3 b) {
-    return a.x * b.x + a.y * b.y + a.z * b.z;
-}
-
-static float vec3_length(Vec3 v) {
-    return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
-}
-
 static Vec3 vec3_normalize(Vec3 v) {
     float len = vec3_length(v);
     if (len > 0.0001f) {
@@ -132,121 +753,187 @@ static Vec3 vec3_normalize(Vec3 v) {
     Vec3 zero = { 0, 0, 0 };
     return zero;
 }
+#endif
 
-static Vec3 rotateX(Vec3 v, float angle) {
-    float c = cosf(angle), s = sinf(angle);
-    Vec3 r = { v.x, v.y * c - v.z * s, v.y * s + v.z * c };
-    return r;
+/* ============================================
+   RANDOM UTILITIES
+   ============================================ */
+
+/* Murmur3's finalizer: a bijection that spreads every input bit */
+static unsigned int mixSeed(unsigned int h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
 }
 
-static Vec3 rotateY(Vec3 v, float angle) {
-    float c = cosf(angle), s = sinf(angle);
-    Vec3 r = { v.x * c + v.z * s, v.y, -v.x * s + v.z * c };
-    return r;
+/*
+ * The same (seed, stream) always gives the same sequence. State words
+ * are distinct mixSeed outputs, so no lane can start all zero.
+ */
+static void seedRng(Rng* rng, unsigned int seed, unsigned int stream) {
+    unsigned int counter = mixSeed(seed) ^ mixSeed(stream * 0x9e3779b9u + 1u);
+    int w, lane;
+    
+    for (w = 0; w < 4; w++) {
+        for (lane = 0; lane < RNG_LANES; lane++) {
+            counter += 0x9e3779b9u;
+            rng->s[w][lane] = mixSeed(counter);
+        }
+    }
 }
 
-static Vec3 rotateZ(Vec3 v, float angle) {
-    float c = cosf(angle), s = sinf(angle);
-    Vec3 r = { v.x * c - v.y * s, v.x * s + v.y * c, v.z };
-    return r;
+/*
+ * Uniform floats in [0, 1) from the top 24 bits of each draw. `out` is
+ * 16-byte aligned with room for `n` rounded up to RNG_LANES; a whole
+ * lane-set is written per step.
+ */
+static void rngFill(Rng* rng, float* out, int n) {
+    int i;
+    
+#if TRANSFORM_LANES > 1
+    __m128i s0 = _mm_load_si128((const __m128i*)rng->s[0]);
+    __m128i s1 = _mm_load_si128((const __m128i*)rng->s[1]);
+    __m128i s2 = _mm_load_si128((const __m128i*)rng->s[2]);
+    __m128i s3 = _mm_load_si128((const __m128i*)rng->s[3]);
+    __m128 unit = _mm_set1_ps(1.0f / 16777216.0f);
+    
+    for (i = 0; i < n; i += RNG_LANES) {
+        __m128i result = _mm_add_epi32(s0, s3);
+        __m128i t = _mm_slli_epi32(s1, 9);
+        
+        s2 = _mm_xor_si128(s2, s0);
+        s3 = _mm_xor_si128(s3, s1);
+        s1 = _mm_xor_si128(s1, s2);
+        s0 = _mm_xor_si128(s0, s3);
+        s2 = _mm_xor_si128(s2, t);
+        s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+        
+        _mm_store_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(result, 8)), unit));
+    }
+    
+    _mm_store_si128((__m128i*)rng->s[0], s0);
+    _mm_store_si128((__m128i*)rng->s[1], s1);
+    _mm_store_si128((__m128i*)rng->s[2], s2);
+    _mm_store_si128((__m128i*)rng->s[3], s3);
+#else
+    for (i = 0; i < n; i += RNG_LANES) {
+        int lane;
+        for (lane = 0; lane < RNG_LANES; lane++) {
+            unsigned int* s0 = &rng->s[0][lane];
+            unsigned int* s1 = &rng->s[1][lane];
+            unsigned int* s2 = &rng->s[2][lane];
+            unsigned int* s3 = &rng->s[3][lane];
+            unsigned int result = *s0 + *s3;
+            unsigned int t = *s1 << 9;
+            
+            *s2 ^= *s0;
+            *s3 ^= *s1;
+            *s1 ^= *s2;
+            *s0 ^= *s3;
+            *s2 ^= t;
+            *s3 = (*s3 << 11) | (*s3 >> 21);
+            
+            out[i + lane] = (float)(result >> 8) * (1.0f / 16777216.0f);
+        }
+    }
+#endif
 }
 
 /* ============================================
-   RANDOM UTILITIES
+   MODEL CREATION
    ============================================ */
 
-static float randf(void) {
-    return (float)rand() / (float)RAND_MAX;
-}
+/*
+ * Finest first; each toaster draws the first level its projected size
+ * reaches. A wing's segments all lie on one tapered prism, so fewer of
+ * them keep its outline and only drop the ribs in between.
+ */
+static const MeshLodSpec k_meshLods[LOD_LEVELS] = {
+    /* pixels   rounded  slots  lever  wing segments */
+    { 32.0f,    TRUE,    TRUE,  TRUE,  5 },
+    { 12.0f,    FALSE,   TRUE,  TRUE,  5 },
+    { 5.0f,     FALSE,   TRUE,  FALSE, 2 },
+    { 0.0f,     FALSE,   FALSE, FALSE, 1 }
+};
 
-static float randf_range(float min, float max) {
-    return min + randf() * (max - min);
+static void addEdge(Model* model, int v1, int v2) {
+    model->edges[model->edgeCount++] = (Edge){ v1, v2 };
 }
 
-/* ============================================
-   MODEL CREATION
-   ============================================ */
+/* A closed four-sided loop: slots and the lever */
+static void addQuad(Model* model, Vec3 a, Vec3 b, Vec3 c, Vec3 d) {
+    int base = model->vertexCount;
+    
+    model->vertices[base + 0] = a;
+    model->vertices[base + 1] = b;
+    model->vertices[base + 2] = c;
+    model->vertices[base + 3] = d;
+    model->vertexCount += 4;
+    
+    addEdge(model, base + 0, base + 1);
+    addEdge(model, base + 1, base + 2);
+    addEdge(model, base + 2, base + 3);
+    addEdge(model, base + 3, base + 0);
+}
 
-static void createToasterBody(Model* model) {
+static void createToasterBody(Model* model, const MeshLodSpec* lod) {
+    /* Face outlines in XY; the first four points are the glow corners */
+    static const float boxOutline[][2] = {
+        { -1.0f, -0.6f }, { 1.0f, -0.6f }, { 1.0f, 0.6f }, { -1.0f, 0.6f }
+    };
+    static const float roundedOutline[][2] = {
+        { -1.0f, -0.6f }, { 1.0f, -0.6f }, { 1.0f, 0.4f }, { -1.0f, 0.4f },
+        { 0.8f, 0.6f }, { -0.8f, 0.6f }
+    };
+    static const int boxWalk[] = { 0, 1, 2, 3 };
+    static const int roundedWalk[] = { 0, 1, 2, 4, 5, 3 };
+    const float (*outline)[2] = lod->rounded ? roundedOutline : boxOutline;
+    const int* walk = lod->rounded ? roundedWalk : boxWalk;
+    int n = lod->rounded ? 6 : 4;
+    int face, i;
+    
     model->vertexCount = 0;
     model->edgeCount = 0;
     
-    /* Front face */
-    model->vertices[0] = (Vec3){ -1.0f, -0.6f, 0.5f };
-    model->vertices[1] = (Vec3){ 1.0f, -0.6f, 0.5f };
-    model->vertices[2] = (Vec3){ 1.0f, 0.6f, 0.5f };
-    model->vertices[3] = (Vec3){ -1.0f, 0.6f, 0.5f };
-    
-    /* Back face */
-    model->vertices[4] = (Vec3){ -1.0f, -0.6f, -0.5f };
-    model->vertices[5] = (Vec3){ 1.0f, -0.6f, -0.5f };
-    model->vertices[6] = (Vec3){ 1.0f, 0.6f, -0.5f };
-    model->vertices[7] = (Vec3){ -1.0f, 0.6f, -0.5f };
-    
-    /* Bread slot 1 */
-    model->vertices[8] = (Vec3){ -0.7f, 0.6f, 0.3f };
-    model->vertices[9] = (Vec3){ -0.3f, 0.6f, 0.3f };
-    model->vertices[10] = (Vec3){ -0.3f, 0.6f, -0.3f };
-    model->vertices[11] = (Vec3){ -0.7f, 0.6f, -0.3f };
-    
-    /* Bread slot 2 */
-    model->vertices[12] = (Vec3){ 0.3f, 0.6f, 0.3f };
-    model->vertices[13] = (Vec3){ 0.7f, 0.6f, 0.3f };
-    model->vertices[14] = (Vec3){ 0.7f, 0.6f, -0.3f };
-    model->vertices[15] = (Vec3){ 0.3f, 0.6f, -0.3f };
+    /* Front face, back face, then the edges connecting them */
+    for (face = 0; face < 2; face++) {
+        int base = face * n;
+        for (i = 0; i < n; i++) {
+            model->vertices[base + i] = (Vec3){ outline[i][0], outline[i][1], face ? -0.5f : 0.5f };
+        }
+        for (i = 0; i < n; i++) {
+            addEdge(model, base + walk[i], base + walk[(i + 1) % n]);
+        }
+    }
+    model->vertexCount = 2 * n;
+    for (i = 0; i < n; i++) {
+        addEdge(model, i, n + i);
+    }
     
-    /* Lever */
-    model->vertices[16] = (Vec3){ 0.9f, 0.2f, 0.51f };
-    model->vertices[17] = (Vec3){ 1.1f, 0.2f, 0.51f };
-    model->vertices[18] = (Vec3){ 1.1f, 0.5f, 0.51f };
-    model->vertices[19] = (Vec3){ 0.9f, 0.5f, 0.51f };
-    
-    model->vertexCount = 20;
-    
-    /* Front face edges */
-    model->edges[0] = (Edge){ 0, 1 };
-    model->edges[1] = (Edge){ 1, 2 };
-    model->edges[2] = (Edge){ 2, 3 };
-    model->edges[3] = (Edge){ 3, 0 };
-    
-    /* Back face edges */
-    model->edges[4] = (Edge){ 4, 5 };
-    model->edges[5] = (Edge){ 5, 6 };
-    model->edges[6] = (Edge){ 6, 7 };
-    model->edges[7] = (Edge){ 7, 4 };
-    
-    /* Connecting edges */
-    model->edges[8] = (Edge){ 0, 4 };
-    model->edges[9] = (Edge){ 1, 5 };
-    model->edges[10] = (Edge){ 2, 6 };
-    model->edges[11] = (Edge){ 3, 7 };
-    
-    /* Slot 1 */
-    model->edges[12] = (Edge){ 8, 9 };
-    model->edges[13] = (Edge){ 9, 10 };
-    model->edges[14] = (Edge){ 10, 11 };
-    model->edges[15] = (Edge){ 11, 8 };
-    
-    /* Slot 2 */
-    model->edges[16] = (Edge){ 12, 13 };
-    model->edges[17] = (Edge){ 13, 14 };
-    model->edges[18] = (Edge){ 14, 15 };
-    model->edges[19] = (Edge){ 15, 12 };
+    /* Bread slots */
+    if (lod->slots) {
+        addQuad(model, (Vec3){ -0.7f, 0.6f, 0.3f }, (Vec3){ -0.3f, 0.6f, 0.3f },
+                (Vec3){ -0.3f, 0.6f, -0.3f }, (Vec3){ -0.7f, 0.6f, -0.3f });
+        addQuad(model, (Vec3){ 0.3f, 0.6f, 0.3f }, (Vec3){ 0.7f, 0.6f, 0.3f },
+                (Vec3){ 0.7f, 0.6f, -0.3f }, (Vec3){ 0.3f, 0.6f, -0.3f });
+    }
     
     /* Lever */
-    model->edges[20] = (Edge){ 16, 17 };
-    model->edges[21] = (Edge){ 17, 18 };
-    model->edges[22] = (Edge){ 18, 19 };
-    model->edges[23] = (Edge){ 19, 16 };
+    if (lod->lever) {
+        addQuad(model, (Vec3){ 0.9f, 0.2f, 0.51f }, (Vec3){ 1.1f, 0.2f, 0.51f },
+                (Vec3){ 1.1f, 0.5f, 0.51f }, (Vec3){ 0.9f, 0.5f, 0.51f });
+    }
     
-    model->edgeCount = 24;
+    model->coreEdgeCount = model->edgeCount;
 }
 
-static void createWing(Model* model, int isLeft) {
+static void createWing(Model* model, int isLeft, int wingSegments) {
     float mirror = isLeft ? -1.0f : 1.0f;
     float baseX = mirror * 1.0f;
     float wingLength = 1.8f;
-    int wingSegments = 5;
     int i;
     
     model->vertexCount = 0;
@@ -285,11 +972,7 @@ static void createWing(Model* model, int isLeft) {
         model->edges[edgeBase + 6] = (Edge){ base + 2, base + 6 };
         model->edges[edgeBase + 7] = (Edge){ base + 3, base + 7 };
         
-        /* Cross bracing */
-        model->edges[edgeBase + 8] = (Edge){ base, base + 5 };
-        model->edges[edgeBase + 9] = (Edge){ base + 1, base + 4 };
-        
-        model->edgeCount += 10;
+        model->edgeCount += 8;
     }
     
     /* Final segment */
@@ -302,358 +985,3790 @@ static void createWing(Model* model, int isLeft) {
         model->edges[edgeBase + 3] = (Edge){ last + 1, last + 3 };
         model->edgeCount += 4;
     }
+    
+    /* Cross bracing goes last so reduced quality can stop short of it */
+    model->coreEdgeCount = model->edgeCount;
+    for (i = 0; i < wingSegments; i++) {
+        int base = i * 4;
+        int edgeBase = model->edgeCount;
+        model->edges[edgeBase + 0] = (Edge){ base, base + 5 };
+        model->edges[edgeBase + 1] = (Edge){ base + 1, base + 4 };
+        model->edgeCount += 2;
+    }
 }
 
-/* ============================================
-   TOASTER MANAGEMENT
-   ============================================ */
-
-static void resetToaster(FlyingToaster* toaster, BOOL initial) {
-    if (initial) {
-        toaster->x = randf() * g_screenWidth;
-        toaster->y = randf() * g_screenHeight;
-    } else {
-        toaster->x = g_screenWidth + 100.0f + randf() * 200.0f;
-        toaster->y = -100.0f - randf() * 200.0f;
+static void packMeshPart(MeshSoA* mesh, const Model* model, int part) {
+    int base = part * MESH_PART_STRIDE;
+    float pivotX = part == MESH_PART_LEFT_WING ? -1.0f : part == MESH_PART_RIGHT_WING ? 1.0f : 0.0f;
+    int i;
+    
+    for (i = 0; i < MESH_PART_STRIDE; i++) {
+        /* Padding lanes repeat vertex 0 so they project like real ones */
+        const Vec3* v = &model->vertices[i < model->vertexCount ? i : 0];
+        mesh->x[base + i] = v->x;
+        mesh->y[base + i] = v->y;
+        mesh->z[base + i] = v->z;
     }
+    mesh->partVertexCount[part] = model->vertexCount;
     
-    toaster->z = 200.0f + randf() * 400.0f;
-    toaster->speed = 1.5f + randf() * 1.5f;
-    toaster->wobble = randf() * (float)M_PI * 2.0f;
-    toaster->wobbleSpeed = 0.02f + randf() * 0.02f;
-    toaster->wingPhase = randf() * (float)M_PI * 2.0f;
-    toaster->wingSpeed = 0.15f + randf() * 0.05f;
-    toaster->rotY = -0.3f + randf() * 0.2f;
-    toaster->rotX = 0.2f + randf() * 0.1f;
-    toaster->scale = 40.0f + randf() * 30.0f;
+    /* Wings flap about (+-1, 0) in XY, so they reach at most pivot + arm */
+    for (i = 0; i < model->vertexCount; i++) {
+        Vec3 arm = model->vertices[i];
+        float reach;
+        if (part != MESH_PART_BODY) arm.x -= pivotX;
+        reach = fabsf(pivotX) + vec3_length(arm);
+        if (reach > g_meshRadius) g_meshRadius = reach;
+    }
 }
 
-static void initToaster(FlyingToaster* toaster) {
-    createToasterBody(&toaster->body);
-    createWing(&toaster->leftWing, 1);
-    createWing(&toaster->rightWing, 0);
-    resetToaster(toaster, TRUE);
+/* Append edges [first, last) of one part to the unified list, skipping any already in it */
+static void appendPartEdges(MeshLod* mesh, const Model* model, int part, int first, int last) {
+    int i, j;
+    
+    for (i = first; i < last; i++) {
+        int v1 = part * MESH_PART_STRIDE + model->edges[i].v1;
+        int v2 = part * MESH_PART_STRIDE + model->edges[i].v2;
+        
+        for (j = 0; j < mesh->edgeCount; j++) {
+            const Edge* e = &mesh->edges[j];
+            if ((e->v1 == v1 && e->v2 == v2) || (e->v1 == v2 && e->v2 == v1)) break;
+        }
+        if (j == mesh->edgeCount && v1 != v2) mesh->edges[mesh->edgeCount++] = (Edge){ v1, v2 };
+    }
 }
 
-static void updateToaster(FlyingToaster* toaster) {
-    /* Flight movement: top-right to bottom-left */
-    toaster->x -= toaster->speed * 2.0f;
-    toaster->y += toaster->speed * 1.5f;
-    toaster->wobble += toaster->wobbleSpeed;
-    toaster->wingPhase += toaster->wingSpeed;
+static void createToasterModels(void) {
+    int lod;
     
-    /* Reset if off screen */
-    if (toaster->x < -200 || toaster->y > g_screenHeight + 200) {
-        resetToaster(toaster, FALSE);
+    if (g_modelsBuilt) return;
+    for (lod = 0; lod < LOD_LEVELS; lod++) {
+        MeshLod* mesh = &g_meshLods[lod];
+        
+        createToasterBody(&mesh->body, &k_meshLods[lod]);
+        createWing(&mesh->wings[0], 1, k_meshLods[lod].wingSegments);
+        createWing(&mesh->wings[1], 0, k_meshLods[lod].wingSegments);
+        
+        packMeshPart(&mesh->soa, &mesh->body, MESH_PART_BODY);
+        packMeshPart(&mesh->soa, &mesh->wings[0], MESH_PART_LEFT_WING);
+        packMeshPart(&mesh->soa, &mesh->wings[1], MESH_PART_RIGHT_WING);
+        
+        /* Detail edges last, so reduced quality draws a prefix of the list */
+        mesh->edgeCount = 0;
+        appendPartEdges(mesh, &mesh->body, MESH_PART_BODY, 0, mesh->body.edgeCount);
+        appendPartEdges(mesh, &mesh->wings[0], MESH_PART_LEFT_WING, 0, mesh->wings[0].coreEdgeCount);
+        appendPartEdges(mesh, &mesh->wings[1], MESH_PART_RIGHT_WING, 0, mesh->wings[1].coreEdgeCount);
+        mesh->coreEdgeCount = mesh->edgeCount;
+        appendPartEdges(mesh, &mesh->wings[0], MESH_PART_LEFT_WING,
+                        mesh->wings[0].coreEdgeCount, mesh->wings[0].edgeCount);
+        appendPartEdges(mesh, &mesh->wings[1], MESH_PART_RIGHT_WING,
+                        mesh->wings[1].coreEdgeCount, mesh->wings[1].edgeCount);
     }
+    g_modelsBuilt = TRUE;
 }
 
-static float getWingAngle(FlyingToaster* toaster) {
-    return sinf(toaster->wingPhase) * 0.5f;
+/*
+ * The level toaster t draws at: the first, from g_finestLod, that its
+ * size at the centre (back buffer pixels per model unit) still reaches.
+ */
+static int toasterLod(const ToasterFlock* flock, int t, float pixelScale) {
+    float pixels = flock->scale[t] * FOV / (flock->z[t] + FOV) * pixelScale;
+    int lod = g_finestLod;
+    
+    while (lod < LOD_LEVELS - 1 && pixels < k_meshLods[lod].minPixels) lod++;
+    return lod;
 }
 
 /* ============================================
-   RENDERING
+   TOASTER MANAGEMENT
    ============================================ */
 
-static Color computeVertexColor(Vec3 vertex, Vec3 normal) {
-    Color baseColor = { 0, 200, 255 };      /* Cyan */
-    Color highlightColor = { 255, 100, 255 }; /* Magenta */
+static BOOL allocFlock(ToasterFlock* flock, int count) {
+    /* Round up so SIMD loops can run whole vectors past `count` */
+    int capacity = (count + 7) & ~7;
+    float* base;
+    int f;
     
-    float ndotl = vec3_dot(normal, g_lightDir);
-    if (ndotl < 0) ndotl = 0;
+    base = (float*)_aligned_malloc(sizeof(float) * capacity * FLOCK_FIELD_COUNT, 32);
+    if (!base) return FALSE;
+    ZeroMemory(base, sizeof(float) * capacity * FLOCK_FIELD_COUNT);
     
-    float ambient = 0.3f;
-    float diffuse = 0.7f * ndotl;
-    float intensity = ambient + diffuse;
+    flock->block = base;
+    flock->count = count;
+    flock->total = count;
+    flock->capacity = capacity;
     
-    /* Height-based color blend */
-    float heightBlend = (vertex.y + 1.0f) / 2.0f;
-    if (heightBlend < 0) heightBlend = 0;
-    if (heightBlend > 1) heightBlend = 1;
+    f = 0;
+    flock->x           = base + capacity * f++;
+    flock->y           = base + capacity * f++;
+    flock->wobble      = base + capacity * f++;
+    flock->wingPhase   = base + capacity * f++;
+    flock->speed       = base + capacity * f++;
+    flock->wobbleSpeed = base + capacity * f++;
+    flock->wingSpeed   = base + capacity * f++;
+    flock->z           = base + capacity * f++;
+    flock->rotX        = base + capacity * f++;
+    flock->rotY        = base + capacity * f++;
+    flock->scale       = base + capacity * f++;
+    flock->depthBucket = (int*)(base + capacity * f++);
+    flock->depthNext   = (int*)(base + capacity * f++);
+    flock->depthPrev   = (int*)(base + capacity * f++);
     
-    Color result;
-    result.r = (BYTE)(((float)baseColor.r * (1.0f - heightBlend) + 
-                       (float)highlightColor.r * heightBlend) * intensity);
-    result.g = (BYTE)(((float)baseColor.g * (1.0f - heightBlend) + 
-                       (float)highlightColor.g * heightBlend) * intensity);
-    result.b = (BYTE)(((float)baseColor.b * (1.0f - heightBlend) + 
-                       (float)highlightColor.b * heightBlend) * intensity);
+    for (f = 0; f < capacity; f++) flock->depthBucket[f] = -1;
+    for (f = 0; f < DEPTH_BUCKETS; f++) flock->depthHead[f] = -1;
     
-    return result;
+    /* Keep total screen coverage roughly constant as the flock grows */
+    flock->sizeScale = 1.0f;
+    if (count > MAX_TOASTERS) {
+        flock->sizeScale = sqrtf((float)DEFAULT_TOASTERS / (float)count);
+        if (flock->sizeScale < 0.15f) flock->sizeScale = 0.15f;
+    }
+    return TRUE;
 }
 
-static BOOL project(Vec3 vertex, float centerX, float centerY, ProjectedPoint* out) {
-    float z = vertex.z + FOV;
-    if (z <= 0) return FALSE;
+static void freeFlock(ToasterFlock* flock) {
+    if (flock->block) _aligned_free(flock->block);
+    ZeroMemory(flock, sizeof(*flock));
+}
+
+static int depthBucketOf(float z) {
+    int b = (int)((z - SPAWN_Z_MIN) * ((float)DEPTH_BUCKETS / SPAWN_Z_RANGE));
+    return b < 0 ? 0 : b >= DEPTH_BUCKETS ? DEPTH_BUCKETS - 1 : b;
+}
+
+/* Painter's order: farther first, ties by lower index so it's stable */
+static BOOL drawsBefore(const ToasterFlock* flock, int a, int b) {
+    return flock->z[a] > flock->z[b] || (flock->z[a] == flock->z[b] && a < b);
+}
+
+static void unlinkDepth(ToasterFlock* flock, int i) {
+    int prev = flock->depthPrev[i], next = flock->depthNext[i];
     
-    float scale = FOV / z;
-    out->x = centerX + vertex.x * scale;
-    out->y = centerY - vertex.y * scale;
-    out->z = z;
-    out->scale = scale;
+    if (prev >= 0) flock->depthNext[prev] = next;
+    else flock->depthHead[flock->depthBucket[i]] = next;
+    if (next >= 0) flock->depthPrev[next] = prev;
+    flock->depthBucket[i] = -1;
+}
+
+/* O(1) on average: a slice holds about total / DEPTH_BUCKETS toasters */
+static void linkDepth(ToasterFlock* flock, int i) {
+    int b = depthBucketOf(flock->z[i]);
+    int prev = -1, next = flock->depthHead[b];
+    
+    while (next >= 0 && drawsBefore(flock, next, i)) {
+        prev = next;
+        next = flock->depthNext[next];
+    }
+    
+    flock->depthBucket[i] = b;
+    flock->depthPrev[i] = prev;
+    flock->depthNext[i] = next;
+    if (prev >= 0) flock->depthNext[prev] = i;
+    else flock->depthHead[b] = i;
+    if (next >= 0) flock->depthPrev[next] = i;
+}
+
+static void resetToaster(ToasterFlock* flock, int i, BOOL initial) {
+    DECLSPEC_ALIGN(16) float r[RESPAWN_DRAWS];
+    
+    rngFill(&flock->rng, r, RESPAWN_DRAWS);
+    
+    if (initial) {
+        flock->x[i] = r[0] * flock->width;
+        flock->y[i] = r[1] * flock->height;
+    } else {
+        flock->x[i] = flock->width + 100.0f + r[0] * 200.0f;
+        flock->y[i] = -100.0f - r[1] * 200.0f;
+    }
+    
+    if (flock->depthBucket[i] >= 0) unlinkDepth(flock, i);
+    flock->z[i] = SPAWN_Z_MIN + r[2] * SPAWN_Z_RANGE;
+    linkDepth(flock, i);
+    flock->speed[i] = 1.5f + r[3] * 1.5f;
+    flock->wobble[i] = r[4] * (float)M_PI * 2.0f;
+    flock->wobbleSpeed[i] = 0.02f + r[5] * 0.02f;
+    flock->wingPhase[i] = r[6] * (float)M_PI * 2.0f;
+    flock->wingSpeed[i] = 0.15f + r[7] * 0.05f;
+    flock->rotY[i] = -0.3f + r[8] * 0.2f;
+    flock->rotX[i] = 0.2f + r[9] * 0.1f;
+    flock->scale[i] = (40.0f + r[10] * 30.0f) * flock->sizeScale;
+}
+
+static void initFlock(ToasterFlock* flock) {
+    int i;
+    for (i = 0; i < flock->total; i++) {
+        resetToaster(flock, i, TRUE);
+    }
+}
+
+/* `step` is elapsed time in 60 Hz ticks, so motion is frame-rate independent */
+static void updateToasters(ToasterFlock* flock, float step) {
+    float* x = flock->x;
+    float* y = flock->y;
+    float* wobble = flock->wobble;
+    float* wingPhase = flock->wingPhase;
+    const float* speed = flock->speed;
+    const float* wobbleSpeed = flock->wobbleSpeed;
+    const float* wingSpeed = flock->wingSpeed;
+    float bottom = flock->height + 200.0f;
+    float dx = 2.0f * step;
+    float dy = 1.5f * step;
+    int n = flock->total;   /* toasters the governor hides keep flying */
+    int i;
+    
+    /* Flight movement: top-right to bottom-left (branch-free, vectorizes) */
+    for (i = 0; i < n; i++) {
+        x[i] -= speed[i] * dx;
+        y[i] += speed[i] * dy;
+        wobble[i] += wobbleSpeed[i] * step;
+        wingPhase[i] += wingSpeed[i] * step;
+    }
+    
+    /* Keep phases small so sinf stays accurate over long sessions */
+    for (i = 0; i < n; i++) {
+        if (wingPhase[i] > 2.0f * (float)M_PI) wingPhase[i] -= 2.0f * (float)M_PI;
+        if (wobble[i] > 2.0f * (float)M_PI) wobble[i] -= 2.0f * (float)M_PI;
+    }
+    
+    /* Reset if off screen */
+    for (i = 0; i < n; i++) {
+        if (x[i] < -200.0f || y[i] > bottom) {
+            resetToaster(flock, i, FALSE);
+        }
+    }
+}
+
+/* Nearest baked flap pose; wingPhase stays within [0, 2 pi] */
+static int getWingKeyframe(const ToasterFlock* flock, int i) {
+    int k = (int)(flock->wingPhase[i] * ((float)WING_KEYFRAMES / (2.0f * (float)M_PI)) + 0.5f);
+    return k & (WING_KEYFRAMES - 1);
+}
+
+/* ============================================
+   BACK BUFFER
+   ============================================ */
+
+static BOOL createFramebuffer(Framebuffer* fb, HDC screenDC, int width, int height) {
+    BITMAPINFO bmi;
+    void* bits = NULL;
+    
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+    
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;   /* top-down */
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    
+    fb->dc = CreateCompatibleDC(screenDC);
+    if (!fb->dc) return FALSE;
+    
+    fb->bitmap = CreateDIBSection(screenDC, &bmi, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!fb->bitmap || !bits) {
+        DeleteDC(fb->dc);
+        fb->dc = NULL;
+        fb->bitmap = NULL;
+        return FALSE;
+    }
+    
+    fb->oldBitmap = (HBITMAP)SelectObject(fb->dc, fb->bitmap);
+    fb->pixels = (DWORD*)bits;
+    fb->width = width;
+    fb->height = height;
+    fb->pitch = width;
+    return TRUE;
+}
+
+static void destroyFramebuffer(Framebuffer* fb) {
+    if (fb->dc) {
+        SelectObject(fb->dc, fb->oldBitmap);
+        DeleteObject(fb->bitmap);
+        DeleteDC(fb->dc);
+    }
+    ZeroMemory(fb, sizeof(*fb));
+}
+
+static void fillFramebufferRows(Framebuffer* fb, int top, int bottom, DWORD color) {
+    int count = fb->pitch * (bottom - top);
+    DWORD* p = fb->pixels + top * fb->pitch;
+    int i;
+    for (i = 0; i < count; i++) {
+        p[i] = color;
+    }
+}
+
+/*
+ * Each channel keeps keep / 256 of its height above `background` (8.8
+ * fixed point, rounded down so a fade always settles). Channels below
+ * the background snap to it. keep may be 0 ..= 256.
+ */
+static void scaleSpan(DWORD* p, int count, DWORD background, int keep) {
+    int i = 0;
+    
+#if TRANSFORM_LANES > 1
+    __m128i bg = _mm_set1_epi32((int)background);
+    __m128i k = _mm_set1_epi16((short)keep);
+    __m128i zero = _mm_setzero_si128();
+    
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = _mm_subs_epu8(_mm_loadu_si128((const __m128i*)(p + i)), bg);
+        __m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), k), 8);
+        __m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), k), 8);
+        _mm_storeu_si128((__m128i*)(p + i), _mm_add_epi8(_mm_packus_epi16(lo, hi), bg));
+    }
+#endif
+    for (; i < count; i++) {
+        DWORD c = p[i];
+        DWORD out = 0;
+        int shift;
+        for (shift = 0; shift < 24; shift += 8) {
+            int v = (int)((c >> shift) & 0xFF);
+            int b = (int)((background >> shift) & 0xFF);
+            if (v > b) b += ((v - b) * keep) >> 8;
+            out |= (DWORD)b << shift;
+        }
+        p[i] = out;
+    }
+}
+
+/* Trail fade toward the background */
+static void decayFramebufferRows(Framebuffer* fb, int top, int bottom, DWORD background, int decay) {
+    scaleSpan(fb->pixels + top * fb->pitch, fb->pitch * (bottom - top), background, decay);
+}
+
+/* Fade factor for a frame of dt seconds, so trail length ignores frame rate */
+static int trailDecay(float dt) {
+    int decay = (int)(256.0f * powf(TRAIL_DECAY, dt * SIM_TICK_RATE));
+    if (decay < 1) decay = 1;
+    if (decay > 255) decay = 255;
+    return decay;
+}
+
+static void fillFramebuffer(Framebuffer* fb, DWORD color) {
+    fillFramebufferRows(fb, 0, fb->height, color);
+}
+
+/* Darken every spacing-th row of rect within rows [top, bottom) */
+static void darkenScanlines(Framebuffer* fb, const RECT* rect, int top, int bottom,
+                            int spacing, int keep) {
+    int y;
+    
+    if (top < rect->top) top = rect->top;
+    if (bottom > rect->bottom) bottom = rect->bottom;
+    for (y = (top + spacing - 1) / spacing * spacing; y < bottom; y += spacing) {
+        DWORD* row = fb->pixels + y * fb->pitch + rect->left;
+        if (keep) {
+            scaleSpan(row, rect->right - rect->left, 0, keep);
+        } else {
+            ZeroMemory(row, sizeof(DWORD) * (rect->right - rect->left));
+        }
+    }
+}
+
+/* Rows [top, bottom) of rect, already clipped to the framebuffer */
+static void fillFramebufferRect(Framebuffer* fb, const RECT* rect, int top, int bottom, DWORD color) {
+    int y, x;
+    
+    if (top < rect->top) top = rect->top;
+    if (bottom > rect->bottom) bottom = rect->bottom;
+    for (y = top; y < bottom; y++) {
+        DWORD* p = fb->pixels + y * fb->pitch;
+        for (x = rect->left; x < rect->right; x++) {
+            p[x] = color;
+        }
+    }
+}
+
+/* ============================================
+   GDI RESOURCE CACHE
+   ============================================ */
+
+static int quantizeColor(int r, int g, int b) {
+    int qr = (r + CACHE_COLOR_STEP / 2) / CACHE_COLOR_STEP;
+    int qg = (g + CACHE_COLOR_STEP / 2) / CACHE_COLOR_STEP;
+    int qb = (b + CACHE_COLOR_STEP / 2) / CACHE_COLOR_STEP;
+    return (qr * CACHE_COLOR_LEVELS + qg) * CACHE_COLOR_LEVELS + qb;
+}
+
+static COLORREF quantizedColorRef(int key) {
+    int qb = key % CACHE_COLOR_LEVELS;
+    int qg = (key / CACHE_COLOR_LEVELS) % CACHE_COLOR_LEVELS;
+    int qr = key / (CACHE_COLOR_LEVELS * CACHE_COLOR_LEVELS);
+    return RGB(qr * CACHE_COLOR_STEP, qg * CACHE_COLOR_STEP, qb * CACHE_COLOR_STEP);
+}
+
+static HPEN getCachedPen(int key, int width) {
+    HPEN* slot;
+    if (width < 1) width = 1;
+    if (width > MAX_LINE_WIDTH) width = MAX_LINE_WIDTH;
+    
+    /* Per-monitor render threads share the cache; the first pen published wins */
+    slot = &g_gdi.pens[width - 1][key];
+    if (!*slot) {
+        HPEN pen = CreatePen(PS_SOLID, width, quantizedColorRef(key));
+        if (pen && InterlockedCompareExchangePointer((PVOID volatile*)slot, pen, NULL) != NULL) {
+            DeleteObject(pen);
+        }
+    }
+    
+    /* Out of handles: a thinner pen, then a stock one; the slot is retried next time */
+    if (!*slot && width > 1) return getCachedPen(key, 1);
+    return *slot ? *slot : (HPEN)GetStockObject(WHITE_PEN);
+}
+
+static void createGdiCache(void) {
+    g_gdi.clearBrush = CreateSolidBrush(RGB(0, 0, 8));
+}
+
+static void destroyGdiCache(void) {
+    int w, i;
+    
+    for (w = 0; w < MAX_LINE_WIDTH; w++) {
+        for (i = 0; i < CACHE_COLOR_COUNT; i++) {
+            if (g_gdi.pens[w][i]) DeleteObject(g_gdi.pens[w][i]);
+        }
+    }
+    if (g_gdi.clearBrush) DeleteObject(g_gdi.clearBrush);
+    
+    ZeroMemory(&g_gdi, sizeof(g_gdi));
+}
+
+/* ============================================
+   FRAME PROFILER
+   ============================================ */
+
+static const char* const k_phaseNames[PHASE_COUNT] = {
+    "clear", "update", "sort", "transform", "raster", "glow", "scanlines", "present", "frame"
+};
+
+static const char* const k_powerNames[POWER_STATE_COUNT] = {
+    "normal", "saver", "display off"
+};
+
+static const char* const k_presentNames[PRESENT_PATH_COUNT] = {
+    "blit", "dirty rects", "flip"
+};
+
+/* Shared QPC clock for the profiler and the frame pacer */
+static LONGLONG qpcNow(void) {
+    LARGE_INTEGER t;
+    QueryPerformanceCounter(&t);
+    return t.QuadPart;
+}
+
+static void initProfiler(FrameProfiler* prof, const char* csvPath) {
+    LARGE_INTEGER freq;
+    int p;
+    
+    ZeroMemory(prof, sizeof(*prof));
+    QueryPerformanceFrequency(&freq);
+    prof->frequency = freq.QuadPart;
+    
+    if (csvPath && csvPath[0]) {
+        prof->csv = fopen(csvPath, "w");
+        if (prof->csv) {
+            fputs("frame", prof->csv);
+            for (p = 0; p < PHASE_COUNT; p++) fprintf(prof->csv, ",%s_ms", k_phaseNames[p]);
+            fputs(",interval_ms,power,present_kb,vblank_latency_ms\n", prof->csv);
+        }
+    }
+}
+
+static void closeProfiler(FrameProfiler* prof) {
+    if (prof->csv) fclose(prof->csv);
+    prof->csv = NULL;
+}
+
+static void profileBegin(FrameProfiler* prof, FramePhase phase) {
+    prof->started[phase] = qpcNow();
+}
+
+static void profileEnd(FrameProfiler* prof, FramePhase phase) {
+    LONGLONG elapsed = qpcNow() - prof->started[phase];
+    prof->current[phase] += (float)((double)elapsed * 1000.0 / (double)prof->frequency);
+}
+
+static int compareFloat(const void* a, const void* b) {
+    float fa = *(const float*)a, fb = *(const float*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+/* min/avg/p99 of n samples; out is zeroed when there are none */
+static void summarizeSamples(const float* samples, int n, PhaseStats* out) {
+    float sorted[PROFILE_WINDOW];
+    float sum = 0.0f;
+    int i;
+    
+    ZeroMemory(out, sizeof(*out));
+    if (n == 0) return;
+    
+    memcpy(sorted, samples, sizeof(float) * n);
+    qsort(sorted, n, sizeof(float), compareFloat);
+    for (i = 0; i < n; i++) sum += sorted[i];
+    
+    out->min = sorted[0];
+    out->avg = sum / (float)n;
+    out->p99 = sorted[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1];
+}
+
+static void refreshProfilerStats(FrameProfiler* prof) {
+    float measured[PROFILE_WINDOW];
+    float busy = 0.0f, wall = 0.0f, sent = 0.0f;
+    int n = prof->historyCount;
+    int p, i, m = 0;
+    
+    if (n == 0) return;
+    
+    for (i = 0; i < n; i++) {
+        busy += prof->history[PHASE_FRAME][i];
+        wall += prof->interval[i];
+        sent += prof->sentKB[i];
+        if (prof->latency[i] >= 0.0f) measured[m++] = prof->latency[i];
+    }
+    prof->busyPercent = wall > 0.0f ? busy * 100.0f / wall : 0.0f;
+    prof->bandwidth = wall > 0.0f ? sent / wall * (1000.0f / 1024.0f) : 0.0f;
+    
+    for (p = 0; p < PHASE_COUNT; p++) {
+        summarizeSamples(prof->history[p], n, &prof->stats[p]);
+    }
+    summarizeSamples(measured, m, &prof->latencyStats);
+    prof->latencyCount = m;
+}
+
+/* A rendered frame just reached the screen; the first one ends the startup time */
+static void profilePresented(FrameProfiler* prof) {
+    if (prof->startupMs == 0.0f && g_startTime) {
+        prof->startupMs = (float)((double)(qpcNow() - g_startTime) * 1000.0 /
+                                  (double)prof->frequency);
+    }
+}
+
+/* Close out the frame: push to history, write CSV, reset accumulators */
+static void profileEndFrame(FrameProfiler* prof) {
+    LONGLONG now = qpcNow();
+    float interval = prof->current[PHASE_FRAME];
+    int p;
+    
+    if (prof->lastFrameEnd) {
+        interval = (float)((double)(now - prof->lastFrameEnd) * 1000.0 / (double)prof->frequency);
+    }
+    prof->lastFrameEnd = now;
+    
+    for (p = 0; p < PHASE_COUNT; p++) {
+        prof->history[p][prof->historyPos] = prof->current[p];
+    }
+    prof->interval[prof->historyPos] = interval;
+    prof->sentKB[prof->historyPos] = prof->presentKB;
+    prof->latency[prof->historyPos] = prof->presentLatency;
+    prof->historyPos = (prof->historyPos + 1) % PROFILE_WINDOW;
+    if (prof->historyCount < PROFILE_WINDOW) prof->historyCount++;
+    
+    if (prof->csv) {
+        fprintf(prof->csv, "%lu", (unsigned long)prof->frameIndex);
+        for (p = 0; p < PHASE_COUNT; p++) fprintf(prof->csv, ",%.4f", prof->current[p]);
+        fprintf(prof->csv, ",%.4f,%s,%.1f,", interval, k_powerNames[prof->power],
+                prof->presentKB);
+        /* Empty when not measured (every path but flip) */
+        if (prof->presentLatency >= 0.0f) fprintf(prof->csv, "%.4f", prof->presentLatency);
+        fputc('\n', prof->csv);
+    }
+    
+    prof->frameIndex++;
+    if (prof->frameIndex % PROFILE_STATS_EVERY == 0) {
+        refreshProfilerStats(prof);
+    }
+    
+    ZeroMemory(prof->current, sizeof(prof->current));
+}
+
+/* Top-left overlay: one row per phase, the frame rate (and quality level, if governed), power, then present */
+static void drawProfilerHud(HDC hdc, const FrameProfiler* prof, int quality) {
+    char line[80];
+    int p, len, y = 8;
+    HGDIOBJ oldFont = SelectObject(hdc, GetStockObject(ANSI_FIXED_FONT));
+    float avgFrame = prof->stats[PHASE_FRAME].avg;
+    
+    SetBkMode(hdc, OPAQUE);
+    SetBkColor(hdc, RGB(0, 0, 0));
+    SetTextColor(hdc, RGB(0, 255, 128));
+    
+    len = wsprintfA(line, "%-10s %8s %8s %8s", "phase (ms)", "min", "avg", "p99");
+    TextOutA(hdc, 8, y, line, len);
+    y += 14;
+    
+    for (p = 0; p < PHASE_COUNT; p++) {
+        /* wsprintf has no %f; print hundredths of a millisecond */
+        len = wsprintfA(line, "%-10s %5d.%02d %5d.%02d %5d.%02d", k_phaseNames[p],
+                        (int)prof->stats[p].min, (int)(prof->stats[p].min * 100.0f) % 100,
+                        (int)prof->stats[p].avg, (int)(prof->stats[p].avg * 100.0f) % 100,
+                        (int)prof->stats[p].p99, (int)(prof->stats[p].p99 * 100.0f) % 100);
+        TextOutA(hdc, 8, y, line, len);
+        y += 14;
+    }
+    
+    len = wsprintfA(line, "%d fps", avgFrame > 0.0f ? (int)(1000.0f / avgFrame) : 0);
+    if (quality >= 0) len += wsprintfA(line + len, "   quality -%d", quality);
+    TextOutA(hdc, 8, y, line, len);
+    y += 14;
+    
+    len = wsprintfA(line, "busy %d%%   power %s   start %d.%02d ms", (int)(prof->busyPercent + 0.5f),
+                    k_powerNames[prof->power], (int)prof->startupMs, (int)(prof->startupMs * 100.0f) % 100);
+    TextOutA(hdc, 8, y, line, len);
+    y += 14;
+    
+    /* Present path, what it sends, and its vblank latency avg / p99 in ms (flip only) */
+    len = wsprintfA(line, "%s %d.%d MB/s  vblank ", k_presentNames[prof->present],
+                    (int)prof->bandwidth, (int)(prof->bandwidth * 10.0f) % 10);
+    if (prof->latencyCount) {
+        len += wsprintfA(line + len, "%d.%02d/%d.%02d ms",
+                         (int)prof->latencyStats.avg, (int)(prof->latencyStats.avg * 100.0f) % 100,
+                         (int)prof->latencyStats.p99, (int)(prof->latencyStats.p99 * 100.0f) % 100);
+    } else {
+        len += wsprintfA(line + len, "n/a");
+    }
+    TextOutA(hdc, 8, y, line, len);
+    
+    SelectObject(hdc, oldFont);
+}
+
+/* ============================================
+   RENDERING
+   ============================================ */
+
+/* Ambient plus diffuse over a cyan-to-magenta blend; heightBlend is 0 at y = -1 */
+static Color lightingColor(float ndotl, float heightBlend) {
+    Color baseColor = { 0, 200, 255 };      /* Cyan */
+    Color highlightColor = { 255, 100, 255 }; /* Magenta */
+    
+    if (ndotl < 0) ndotl = 0;
+    
+    float ambient = 0.3f;
+    float diffuse = 0.7f * ndotl;
+    float intensity = ambient + diffuse;
+    
+    if (heightBlend < 0) heightBlend = 0;
+    if (heightBlend > 1) heightBlend = 1;
+    
+    Color result;
+    result.r = (BYTE)(((float)baseColor.r * (1.0f - heightBlend) + 
+                       (float)highlightColor.r * heightBlend) * intensity);
+    result.g = (BYTE)(((float)baseColor.g * (1.0f - heightBlend) + 
+                       (float)highlightColor.g * heightBlend) * intensity);
+    result.b = (BYTE)(((float)baseColor.b * (1.0f - heightBlend) + 
+                       (float)highlightColor.b * heightBlend) * intensity);
+    
+    return result;
+}
+
+/* Bake lightingColor for the current light; a no-op while it's unchanged */
+static void buildLightingTables(void) {
+    static const Vec3 wingNormal = { 0, 1.0f, 0 };
+    float wingNdotl = vec3_dot(wingNormal, g_lightDir);
+    int n, h;
+    
+    if (g_lighting.built && g_lighting.lightDir.x == g_lightDir.x &&
+        g_lighting.lightDir.y == g_lightDir.y && g_lighting.lightDir.z == g_lightDir.z) {
+        return;
+    }
+    
+    for (n = 0; n < LIGHT_NDOTL_STEPS; n++) {
+        float ndotl = (float)n / (float)(LIGHT_NDOTL_STEPS - 1);
+        for (h = 0; h < LIGHT_HEIGHT_STEPS; h++) {
+            g_lighting.body[n * LIGHT_HEIGHT_STEPS + h] =
+                lightingColor(ndotl, (float)h / (float)(LIGHT_HEIGHT_STEPS - 1));
+        }
+    }
+    
+    /* Wing coloring - lighter/golden */
+    for (h = 0; h < LIGHT_HEIGHT_STEPS; h++) {
+        Color c = lightingColor(wingNdotl, (float)h / (float)(LIGHT_HEIGHT_STEPS - 1));
+        g_lighting.wing[h].r = (BYTE)min(255, c.r + 100);
+        g_lighting.wing[h].g = (BYTE)min(255, c.g + 50);
+        g_lighting.wing[h].b = c.b;
+    }
+    
+    g_lighting.lightDir = g_lightDir;
+    g_lighting.built = TRUE;
+}
+
+#if TRANSFORM_LANES == 1
+/* pixelScale: back buffer pixels per window pixel; center is already in back buffer pixels */
+static BOOL project(Vec3 vertex, float centerX, float centerY, float pixelScale,
+                    ProjectedPoint* out) {
+    float z = vertex.z + FOV;
+    if (z <= 0) return FALSE;
+    
+    float scale = FOV / z * pixelScale;
+    out->x = centerX + vertex.x * scale;
+    out->y = centerY - vertex.y * scale;
+    out->z = z;
+    out->scale = scale;
+    return TRUE;
+}
+#endif
+
+static Color lerpColor(Color a, Color b, float t) {
+    Color c;
+    c.r = (BYTE)((float)a.r + (float)(b.r - a.r) * t + 0.5f);
+    c.g = (BYTE)((float)a.g + (float)(b.g - a.g) * t + 0.5f);
+    c.b = (BYTE)((float)a.b + (float)(b.b - a.b) * t + 0.5f);
+    return c;
+}
+
+/*
+ * Liang-Barsky: trim p1-p2 to the back buffer grown by MAX_LINE_WIDTH
+ * (so pens and caps reaching in from outside still land), bringing the
+ * colours along. Scale is left alone, so the piece keeps the width of
+ * the whole edge. Returns FALSE when no part of the line is inside.
+ */
+static BOOL clipLine(ProjectedPoint* p1, ProjectedPoint* p2, Color* c1, Color* c2,
+                     int width, int height) {
+    float dx = p2->x - p1->x, dy = p2->y - p1->y;
+    float p[4], q[4];
+    float t0 = 0.0f, t1 = 1.0f;
+    ProjectedPoint a = *p1;
+    Color ca = *c1, cb = *c2;
+    float lo = -(float)MAX_LINE_WIDTH;
+    float right = (float)(width + MAX_LINE_WIDTH), bottom = (float)(height + MAX_LINE_WIDTH);
+    int i;
+    
+    /* Nearly every edge is wholly inside; accept those before any division */
+    if (a.x >= lo && a.x <= right && a.y >= lo && a.y <= bottom &&
+        p2->x >= lo && p2->x <= right && p2->y >= lo && p2->y <= bottom) {
+        return TRUE;
+    }
+    
+    p[0] = -dx; q[0] = a.x + (float)MAX_LINE_WIDTH;
+    p[1] = dx;  q[1] = (float)(width + MAX_LINE_WIDTH) - a.x;
+    p[2] = -dy; q[2] = a.y + (float)MAX_LINE_WIDTH;
+    p[3] = dy;  q[3] = (float)(height + MAX_LINE_WIDTH) - a.y;
+    
+    for (i = 0; i < 4; i++) {
+        float t;
+        if (p[i] == 0.0f) {
+            if (q[i] < 0.0f) return FALSE;
+            continue;
+        }
+        t = q[i] / p[i];
+        if (p[i] < 0.0f) {
+            if (t > t1) return FALSE;
+            if (t > t0) t0 = t;
+        } else {
+            if (t < t0) return FALSE;
+            if (t < t1) t1 = t;
+        }
+    }
+    
+    if (t1 < 1.0f) {
+        p2->x = a.x + dx * t1;
+        p2->y = a.y + dy * t1;
+        *c2 = lerpColor(ca, cb, t1);
+    }
+    if (t0 > 0.0f) {
+        p1->x = a.x + dx * t0;
+        p1->y = a.y + dy * t0;
+        *c1 = lerpColor(ca, cb, t0);
+    }
+    return TRUE;
+}
+
+static float edgeLineWidth(ProjectedPoint p1, ProjectedPoint p2, int maxWidth) {
+    float lineWidth = (p1.scale + p2.scale) * 0.4f;
+    if (lineWidth < 1.0f) lineWidth = 1.0f;
+    if (lineWidth > (float)maxWidth) lineWidth = (float)maxWidth;
+    return lineWidth;
+}
+
+/*
+ * 16.16 fixed-point DDA, stored straight into the DIB. Endpoints keep
+ * their sub-pixel position: the line is stepped along its major axis and
+ * the minor coordinate sampled at each pixel centre, so slow toasters
+ * glide instead of snapping a pixel at a time. Thick lines are a run of
+ * pixels across the minor axis, as many as keep the width measured
+ * perpendicular to the line (one for a 1 px line at any angle). Like the
+ * GDI runs the line is end-exclusive: the major step holding p2 is left
+ * to the edges that start there, and only p1's end runs (width - 1) / 2
+ * past its vertex like a square pen.
+ *
+ * Only rows [clipTop, clipBottom) are written, so bands can run in
+ * parallel. Clipping happens once per line rather than per pixel, and
+ * every fixed-point value is stepped from the unclipped start so each
+ * band produces exactly the pixels a single pass would.
+ */
+static void drawGradientLineDIB(Framebuffer* fb, ProjectedPoint p1, ProjectedPoint p2,
+                                Color c1, Color c2, int maxWidth, int clipTop, int clipBottom) {
+    BOOL xMajor = fabsf(p2.x - p1.x) >= fabsf(p2.y - p1.y);
+    BOOL reverse = xMajor ? p2.x < p1.x : p2.y < p1.y;
+    ProjectedPoint pa = reverse ? p2 : p1;
+    ProjectedPoint pb = reverse ? p1 : p2;
+    Color ca = reverse ? c2 : c1;
+    Color cb = reverse ? c1 : c2;
+    
+    /* Major axis a -> b (ascending), minor coordinate m at a */
+    float a = xMajor ? pa.x : pa.y;
+    float b = xMajor ? pb.x : pb.y;
+    float m = xMajor ? pa.y : pa.x;
+    float slope = b - a > 0.0f ? ((xMajor ? pb.y : pb.x) - m) / (b - a) : 0.0f;
+    float width = (float)(int)edgeLineWidth(p1, p2, maxWidth);
+    float cap = (width - 1.0f) * 0.5f;
+    int span = width > 1.0f ? (int)(width * sqrtf(1.0f + slope * slope) + 0.5f) : 1;
+    float half = 0.5f * (float)span;
+    
+    int majorStart = xMajor ? 0 : clipTop;
+    int majorEnd = xMajor ? fb->width : clipBottom;
+    int minorStart = xMajor ? clipTop : 0;
+    int minorEnd = xMajor ? clipBottom : fb->width;
+    
+    DWORD* pixels = fb->pixels;
+    int pitch = fb->pitch;
+    int first, last, steps, skip, i;
+    int edge, edgeStep;
+    int r, g, bl, dr, dg, db;
+    float lowA, highB, mFirst, mLast;
+    
+    /* Wildly off-screen endpoints (near the eye plane) must not overflow the floors */
+    lowA = reverse ? a : a - cap;
+    highB = reverse ? b + cap : b;
+    if (lowA < -LINE_COORD_LIMIT) lowA = -LINE_COORD_LIMIT;
+    if (highB > LINE_COORD_LIMIT) highB = LINE_COORD_LIMIT;
+    if (lowA > LINE_COORD_LIMIT || highB < -LINE_COORD_LIMIT) return;
+    
+    first = (int)floorf(lowA);
+    last = (int)floorf(highB);
+    steps = last - first;
+    skip = reverse ? 1 : 0;
+    if (!reverse) last--;
+    if (first + skip < majorStart) skip = majorStart - first;
+    if (last > majorEnd - 1) last = majorEnd - 1;
+    if (first + skip > last) return;
+    
+    /* Reject lines that stay off the clip range across the minor axis */
+    mFirst = m + slope * ((float)(first + skip) + 0.5f - a);
+    mLast = m + slope * ((float)last + 0.5f - a);
+    if ((mFirst < mLast ? mLast : mFirst) + half < (float)(minorStart - 1) ||
+        (mFirst < mLast ? mFirst : mLast) - half > (float)(minorEnd + 1)) {
+        return;
+    }
+    
+    /* Lower span edge; rounded to the nearest pixel boundary per step */
+    edgeStep = (int)(slope * 65536.0f);
+    edge = (int)((LONGLONG)((m + slope * ((float)first + 0.5f - a) - half + 0.5f) * 65536.0f) +
+                 (LONGLONG)edgeStep * skip);
+    
+    /* Colour runs end to end over every major step, clipped or not */
+    dr = steps ? (cb.r - ca.r) * 65536 / steps : 0;
+    dg = steps ? (cb.g - ca.g) * 65536 / steps : 0;
+    db = steps ? (cb.b - ca.b) * 65536 / steps : 0;
+    r = (ca.r << 16) + 0x8000 + (int)((LONGLONG)dr * skip);
+    g = (ca.g << 16) + 0x8000 + (int)((LONGLONG)dg * skip);
+    bl = (ca.b << 16) + 0x8000 + (int)((LONGLONG)db * skip);
+    
+    for (i = first + skip; i <= last; i++) {
+        DWORD color = ((DWORD)(r >> 16) << 16) | ((DWORD)(g >> 16) << 8) | (DWORD)(bl >> 16);
+        int lo = edge >> 16;
+        int hi = lo + span;
+        int k;
+        
+        if (lo < minorStart) lo = minorStart;
+        if (hi > minorEnd) hi = minorEnd;
+        
+        if (xMajor) {
+            DWORD* dst = pixels + lo * pitch + i;
+            for (k = lo; k < hi; k++, dst += pitch) *dst = color;
+        } else {
+            DWORD* row = pixels + i * pitch;
+            for (k = lo; k < hi; k++) row[k] = color;
+        }
+        
+        edge += edgeStep;
+        r += dr;
+        g += dg;
+        bl += db;
+    }
+}
+
+/* ============================================
+   GLOW SPRITES
+   ============================================ */
+
+/* Pre-render every radius once; the sprites are shared by all backends */
+static BOOL buildGlowAtlas(GlowAtlas* atlas) {
+    int total = 0;
+    int r, x, y;
+    
+    if (atlas->texels) return TRUE;
+    
+    for (r = GLOW_MIN_RADIUS; r <= GLOW_MAX_RADIUS; r++) {
+        atlas->offset[r] = total;
+        total += (2 * r + 1) * (2 * r + 1);
+    }
+    
+    atlas->texels = (GlowTexel*)malloc(sizeof(GlowTexel) * total);
+    if (!atlas->texels) return FALSE;
+    
+    for (r = GLOW_MIN_RADIUS; r <= GLOW_MAX_RADIUS; r++) {
+        GlowTexel* t = atlas->texels + atlas->offset[r];
+        
+        for (y = -r; y <= r; y++) {
+            for (x = -r; x <= r; x++, t++) {
+                float f = 1.0f - sqrtf((float)(x * x + y * y)) / (float)r;
+                if (f < 0.0f) f = 0.0f;
+                
+                t->tint = (WORD)(0.3f * (f - f * f) * 65536.0f);
+                t->white = (WORD)(0.3f * f * f * 255.0f + 0.5f);
+            }
+        }
+    }
+    return TRUE;
+}
+
+static void freeGlowAtlas(GlowAtlas* atlas) {
+    free(atlas->texels);
+    ZeroMemory(atlas, sizeof(*atlas));
+}
+
+static int glowRadius(float scale) {
+    int radius = (int)(3.0f * scale);
+    if (radius < GLOW_MIN_RADIUS) radius = GLOW_MIN_RADIUS;
+    if (radius > GLOW_MAX_RADIUS) radius = GLOW_MAX_RADIUS;
+    return radius;
+}
+
+/* Glowing vertices of one mesh part: the front corners, or every vertex */
+static int glowVertexCount(const MeshSoA* mesh, int part) {
+    if (g_glowAllVertices) return mesh->partVertexCount[part];
+    return part == MESH_PART_BODY ? GLOW_CORNERS : 0;
+}
+
+/* Saturating additive composite; only rows [clipTop, clipBottom) are touched */
+static void compositeGlow(Framebuffer* fb, ProjectedPoint p, Color c,
+                          int clipTop, int clipBottom) {
+    int radius = glowRadius(p.scale);
+    int side = 2 * radius + 1;
+    const GlowTexel* sprite = g_glowAtlas.texels + g_glowAtlas.offset[radius];
+    int left = (int)p.x - radius;
+    int top = (int)p.y - radius;
+    int x0 = left < 0 ? -left : 0;
+    int x1 = left + side > fb->width ? fb->width - left : side;
+    int y0 = top < clipTop ? clipTop - top : 0;
+    int y1 = top + side > clipBottom ? clipBottom - top : side;
+    int x, y;
+    
+    for (y = y0; y < y1; y++) {
+        DWORD* row = fb->pixels + (top + y) * fb->pitch + left;
+        const GlowTexel* t = sprite + y * side;
+        
+        for (x = x0; x < x1; x++) {
+            DWORD d = row[x];
+            int r = (int)((d >> 16) & 0xFF) + ((c.r * t[x].tint) >> 16) + t[x].white;
+            int g = (int)((d >> 8) & 0xFF) + ((c.g * t[x].tint) >> 16) + t[x].white;
+            int b = (int)(d & 0xFF) + ((c.b * t[x].tint) >> 16) + t[x].white;
+            
+            if (r > 255) r = 255;
+            if (g > 255) g = 255;
+            if (b > 255) b = 255;
+            row[x] = ((DWORD)r << 16) | ((DWORD)g << 8) | (DWORD)b;
+        }
+    }
+}
+
+/* ============================================
+   BATCHED VERTEX TRANSFORM
+   ============================================ */
+
+static void mat34_multiply(const Mat34* a, const Mat34* b, Mat34* out) {
+    int r;
+    for (r = 0; r < 3; r++) {
+        const float* ar = &a->m[r * 4];
+        out->m[r * 4 + 0] = ar[0] * b->m[0] + ar[1] * b->m[4] + ar[2] * b->m[8];
+        out->m[r * 4 + 1] = ar[0] * b->m[1] + ar[1] * b->m[5] + ar[2] * b->m[9];
+        out->m[r * 4 + 2] = ar[0] * b->m[2] + ar[1] * b->m[6] + ar[2] * b->m[10];
+        out->m[r * 4 + 3] = ar[0] * b->m[3] + ar[1] * b->m[7] + ar[2] * b->m[11] + ar[3];
+    }
+}
+
+/* translate(0, 0, depth) * rotateY * rotateX * scale, as renderToaster used to apply */
+static void mat34_toaster(Mat34* out, float scale, float rotX, float rotY, float depth) {
+    float cx = cosf(rotX), sx = sinf(rotX);
+    float cy = cosf(rotY), sy = sinf(rotY);
+    
+    out->m[0] = cy * scale;  out->m[1] = sy * sx * scale;  out->m[2]  = sy * cx * scale;  out->m[3]  = 0.0f;
+    out->m[4] = 0.0f;        out->m[5] = cx * scale;       out->m[6]  = -sx * scale;      out->m[7]  = 0.0f;
+    out->m[8] = -sy * scale; out->m[9] = cy * sx * scale;  out->m[10] = cy * cx * scale;  out->m[11] = depth;
+}
+
+/* Flap rotation about the z axis through (pivotX, 0, 0) */
+static void mat34_wingFlap(Mat34* out, float angle, float pivotX) {
+    float c = cosf(angle), s = sinf(angle);
+    
+    out->m[0] = c;    out->m[1] = -s;   out->m[2]  = 0.0f; out->m[3]  = pivotX - c * pivotX;
+    out->m[4] = s;    out->m[5] = c;    out->m[6]  = 0.0f; out->m[7]  = -s * pivotX;
+    out->m[8] = 0.0f; out->m[9] = 0.0f; out->m[10] = 1.0f; out->m[11] = 0.0f;
+}
+
+/*
+ * The flap angle is sin(wingPhase) * 0.5, so a period of poses covers
+ * every frame; toasters then index these instead of running trig.
+ */
+static void buildWingKeyframes(void) {
+    int k;
+    
+    if (g_wingKeyframesBuilt) return;
+    for (k = 0; k < WING_KEYFRAMES; k++) {
+        float wingAngle = sinf((float)k * (2.0f * (float)M_PI / (float)WING_KEYFRAMES)) * 0.5f;
+        mat34_wingFlap(&g_wingKeyframes[k][0], -wingAngle, -1.0f);
+        mat34_wingFlap(&g_wingKeyframes[k][1], wingAngle, 1.0f);
+    }
+    g_wingKeyframesBuilt = TRUE;
+}
+
+static BOOL allocVertexBatch(VertexBatch* batch, int capacity) {
+    size_t verts = (size_t)capacity * MESH_BATCH_STRIDE;
+    size_t matBytes = sizeof(Mat34) * capacity * MESH_PART_COUNT;
+    size_t floatBytes = sizeof(float) * verts;
+    size_t total = matBytes + floatBytes * 8 + sizeof(Color) * verts +
+                   sizeof(ScreenBounds) * capacity + capacity;
+    BYTE* p;
+    
+    p = (BYTE*)_aligned_malloc(total, 32);
+    if (!p) return FALSE;
+    
+    batch->block = p;
+    batch->capacity = capacity;
+    batch->matrices = (Mat34*)p;            p += matBytes;
+    batch->viewX = (float*)p;               p += floatBytes;
+    batch->viewY = (float*)p;               p += floatBytes;
+    batch->viewZ = (float*)p;               p += floatBytes;
+    batch->screenX = (float*)p;             p += floatBytes;
+    batch->screenY = (float*)p;             p += floatBytes;
+    batch->screenZ = (float*)p;             p += floatBytes;
+    batch->screenScale = (float*)p;         p += floatBytes;
+    batch->valid = (int*)p;                 p += floatBytes;
+    batch->colors = (Color*)p;              p += sizeof(Color) * verts;
+    batch->bounds = (ScreenBounds*)p;      p += sizeof(ScreenBounds) * capacity;
+    batch->lod = p;
+    return TRUE;
+}
+
+static void freeVertexBatch(VertexBatch* batch) {
+    if (batch->block) _aligned_free(batch->block);
+    ZeroMemory(batch, sizeof(*batch));
+}
+
+/* One combined matrix per toaster part; trig runs once per toaster, not per vertex */
+static void buildToasterMatrices(const ToasterFlock* flock, VertexBatch* batch,
+                                 const DepthKey* order, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        int t = order[i].index;
+        Mat34* m = &batch->matrices[t * MESH_PART_COUNT];
+        const Mat34* flap = g_wingKeyframes[getWingKeyframe(flock, t)];
+        
+        mat34_toaster(&m[MESH_PART_BODY], flock->scale[t], flock->rotX[t],
+                      flock->rotY[t], flock->z[t]);
+        mat34_multiply(&m[MESH_PART_BODY], &flap[0], &m[MESH_PART_LEFT_WING]);
+        mat34_multiply(&m[MESH_PART_BODY], &flap[1], &m[MESH_PART_RIGHT_WING]);
+    }
+}
+
+#if TRANSFORM_LANES == 8
+typedef __m256 vfloat;
+#define V_SET1(a)           _mm256_set1_ps(a)
+#define V_ZERO()            _mm256_setzero_ps()
+#define V_LOAD(p)           _mm256_load_ps(p)
+#define V_STORE(p, a)       _mm256_store_ps((p), (a))
+#define V_ADD(a, b)         _mm256_add_ps((a), (b))
+#define V_SUB(a, b)         _mm256_sub_ps((a), (b))
+#define V_MUL(a, b)         _mm256_mul_ps((a), (b))
+#define V_DIV(a, b)         _mm256_div_ps((a), (b))
+#define V_AND(a, b)         _mm256_and_ps((a), (b))
+#define V_CMPGT(a, b)       _mm256_cmp_ps((a), (b), _CMP_GT_OQ)
+#define V_MIN(a, b)         _mm256_min_ps((a), (b))
+#define V_MAX(a, b)         _mm256_max_ps((a), (b))
+#define V_SQRT(a)           _mm256_sqrt_ps(a)
+#define V_ROUND(a)          _mm256_round_ps((a), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC)
+#define V_STORE_INT(p, a)   _mm256_store_si256((__m256i*)(p), _mm256_cvtps_epi32(a))
+#define V_SELECT(m, a, b)   _mm256_blendv_ps((b), (a), (m))
+#elif TRANSFORM_LANES == 4
+typedef __m128 vfloat;
+#define V_SET1(a)           _mm_set1_ps(a)
+#define V_ZERO()            _mm_setzero_ps()
+#define V_LOAD(p)           _mm_load_ps(p)
+#define V_STORE(p, a)       _mm_store_ps((p), (a))
+#define V_ADD(a, b)         _mm_add_ps((a), (b))
+#define V_SUB(a, b)         _mm_sub_ps((a), (b))
+#define V_MUL(a, b)         _mm_mul_ps((a), (b))
+#define V_DIV(a, b)         _mm_div_ps((a), (b))
+#define V_AND(a, b)         _mm_and_ps((a), (b))
+#define V_CMPGT(a, b)       _mm_cmpgt_ps((a), (b))
+#define V_MIN(a, b)         _mm_min_ps((a), (b))
+#define V_MAX(a, b)         _mm_max_ps((a), (b))
+#define V_SQRT(a)           _mm_sqrt_ps(a)
+#define V_ROUND(a)          _mm_cvtepi32_ps(_mm_cvtps_epi32(a))
+#define V_STORE_INT(p, a)   _mm_store_si128((__m128i*)(p), _mm_cvtps_epi32(a))
+#define V_SELECT(m, a, b)   _mm_or_ps(_mm_and_ps((m), (a)), _mm_andnot_ps((m), (b)))
+#endif
+
+/*
+ * Transform + project one mesh part of one toaster into the batch at `out`.
+ * Screen outputs are in back buffer pixels, `pixelScale` per window pixel.
+ */
+static void transformPart(const Mat34* mat, const MeshSoA* mesh, int part, float centerX,
+                          float centerY, float pixelScale, VertexBatch* batch, int out) {
+    const float* mx = &mesh->x[part * MESH_PART_STRIDE];
+    const float* my = &mesh->y[part * MESH_PART_STRIDE];
+    const float* mz = &mesh->z[part * MESH_PART_STRIDE];
+    const float* m = mat->m;
+    int j;
+    
+#if TRANSFORM_LANES > 1
+    vfloat m0 = V_SET1(m[0]), m1 = V_SET1(m[1]), m2 = V_SET1(m[2]), m3 = V_SET1(m[3]);
+    vfloat m4 = V_SET1(m[4]), m5 = V_SET1(m[5]), m6 = V_SET1(m[6]), m7 = V_SET1(m[7]);
+    vfloat m8 = V_SET1(m[8]), m9 = V_SET1(m[9]), m10 = V_SET1(m[10]), m11 = V_SET1(m[11]);
+    vfloat fov = V_SET1(FOV);
+    vfloat zero = V_ZERO();
+    vfloat px = V_SET1(pixelScale);
+    vfloat cx = V_SET1(centerX * pixelScale);
+    vfloat cy = V_SET1(centerY * pixelScale);
+    
+    for (j = 0; j < MESH_PART_STRIDE; j += TRANSFORM_LANES) {
+        vfloat x = V_LOAD(mx + j);
+        vfloat y = V_LOAD(my + j);
+        vfloat z = V_LOAD(mz + j);
+        
+        vfloat vx = V_ADD(V_ADD(V_MUL(m0, x), V_MUL(m1, y)), V_ADD(V_MUL(m2, z), m3));
+        vfloat vy = V_ADD(V_ADD(V_MUL(m4, x), V_MUL(m5, y)), V_ADD(V_MUL(m6, z), m7));
+        vfloat vz = V_ADD(V_ADD(V_MUL(m8, x), V_MUL(m9, y)), V_ADD(V_MUL(m10, z), m11));
+        
+        /* Fused project(): lanes behind the eye get scale 0 and valid 0 */
+        vfloat pz = V_ADD(vz, fov);
+        vfloat valid = V_CMPGT(pz, zero);
+        vfloat scale = V_MUL(V_AND(V_DIV(fov, pz), valid), px);
+        
+        V_STORE(batch->viewX + out + j, vx);
+        V_STORE(batch->viewY + out + j, vy);
+        V_STORE(batch->viewZ + out + j, vz);
+        V_STORE(batch->screenX + out + j, V_ADD(cx, V_MUL(vx, scale)));
+        V_STORE(batch->screenY + out + j, V_SUB(cy, V_MUL(vy, scale)));
+        V_STORE(batch->screenZ + out + j, pz);
+        V_STORE(batch->screenScale + out + j, scale);
+        V_STORE((float*)(batch->valid + out + j), valid);
+    }
+#else
+    for (j = 0; j < MESH_PART_STRIDE; j++) {
+        Vec3 v;
+        ProjectedPoint p = { 0, 0, 0, 0 };
+        
+        v.x = m[0] * mx[j] + m[1] * my[j] + m[2] * mz[j] + m[3];
+        v.y = m[4] * mx[j] + m[5] * my[j] + m[6] * mz[j] + m[7];
+        v.z = m[8] * mx[j] + m[9] * my[j] + m[10] * mz[j] + m[11];
+        
+        batch->viewX[out + j] = v.x;
+        batch->viewY[out + j] = v.y;
+        batch->viewZ[out + j] = v.z;
+        batch->valid[out + j] = project(v, centerX * pixelScale, centerY * pixelScale,
+                                        pixelScale, &p);
+        batch->screenX[out + j] = p.x;
+        batch->screenY[out + j] = p.y;
+        batch->screenZ[out + j] = p.z;
+        batch->screenScale[out + j] = p.scale;
+    }
+#endif
+}
+
+/*
+ * Bounding-sphere test against a width x height back buffer. In view
+ * space toaster t is a sphere of radius mesh radius * scale about
+ * (0, 0, z), so no vertex lands further than r * FOV / (z - r + FOV)
+ * from its screen centre. Spheres reaching the eye plane are kept and
+ * left to the per-vertex test. The pad covers thick lines and glow.
+ */
+static BOOL toasterOnScreen(const ToasterFlock* flock, int t, float pixelScale,
+                            int width, int height) {
+    float r = g_meshRadius * flock->scale[t];
+    float nearZ = flock->z[t] - r + FOV;
+    float x = flock->x[t] * pixelScale;
+    float y = flock->y[t] * pixelScale;
+    float reach;
+    
+    if (flock->z[t] + r + FOV <= 0.0f) return FALSE;
+    if (nearZ <= 0.0f) return TRUE;
+    
+    reach = r * FOV / nearZ * pixelScale + (float)(GLOW_MAX_RADIUS + 1);
+    return x + reach >= 0.0f && x - reach < (float)width &&
+           y + reach >= 0.0f && y - reach < (float)height;
+}
+
+/*
+ * Keys for the drawn toasters that can reach the back buffer, marking
+ * them in `onScreen`; the rest (in transit off-screen, or behind the
+ * eye) are skipped by every later stage. Keys are written in flock
+ * order, so the transform streams through memory. Returns the count.
+ */
+static int cullFlock(const ToasterFlock* flock, DepthKey* order, BYTE* onScreen,
+                     float pixelScale, int width, int height) {
+    int t, count = 0;
+    
+    for (t = 0; t < flock->count; t++) {
+        onScreen[t] = (BYTE)toasterOnScreen(flock, t, pixelScale, width, height);
+        if (!onScreen[t]) continue;
+        order[count].z = flock->z[t];
+        order[count].index = t;
+        count++;
+    }
+    return count;
+}
+
+/*
+ * The marked toasters in drawsBefore order, read straight off the depth
+ * index, so a steady frame does no sorting at all.
+ */
+static void depthOrderFlock(const ToasterFlock* flock, const BYTE* onScreen, DepthKey* order) {
+    int b, t, count = 0;
+    
+    for (b = DEPTH_BUCKETS - 1; b >= 0; b--) {
+        for (t = flock->depthHead[b]; t >= 0; t = flock->depthNext[t]) {
+            if (t >= flock->count || !onScreen[t]) continue;
+            order[count].z = flock->z[t];
+            order[count].index = t;
+            count++;
+        }
+    }
+}
+
+/*
+ * Screen extent of toaster t's valid vertices, read back while they're
+ * still in L1. Padding lanes repeat vertex 0, so they can't widen it.
+ */
+static void boundToaster(VertexBatch* batch, int t) {
+    ScreenBounds* b = &batch->bounds[t];
+    int base = t * MESH_BATCH_STRIDE;
+    int j;
+    
+#if TRANSFORM_LANES > 1
+    DECLSPEC_ALIGN(32) float lanes[4][TRANSFORM_LANES];
+    vfloat big = V_SET1(FLT_MAX), small = V_SET1(-FLT_MAX);
+    vfloat minX = big, minY = big, maxX = small, maxY = small;
+    
+    for (j = base; j < base + MESH_BATCH_STRIDE; j += TRANSFORM_LANES) {
+        vfloat valid = V_LOAD((const float*)(batch->valid + j));
+        vfloat x = V_LOAD(batch->screenX + j);
+        vfloat y = V_LOAD(batch->screenY + j);
+        
+        minX = V_MIN(minX, V_SELECT(valid, x, big));
+        minY = V_MIN(minY, V_SELECT(valid, y, big));
+        maxX = V_MAX(maxX, V_SELECT(valid, x, small));
+        maxY = V_MAX(maxY, V_SELECT(valid, y, small));
+    }
+    
+    V_STORE(lanes[0], minX);
+    V_STORE(lanes[1], minY);
+    V_STORE(lanes[2], maxX);
+    V_STORE(lanes[3], maxY);
+    b->minX = b->minY = FLT_MAX;
+    b->maxX = b->maxY = -FLT_MAX;
+    for (j = 0; j < TRANSFORM_LANES; j++) {
+        if (lanes[0][j] < b->minX) b->minX = lanes[0][j];
+        if (lanes[1][j] < b->minY) b->minY = lanes[1][j];
+        if (lanes[2][j] > b->maxX) b->maxX = lanes[2][j];
+        if (lanes[3][j] > b->maxY) b->maxY = lanes[3][j];
+    }
+#else
+    b->minX = b->minY = FLT_MAX;
+    b->maxX = b->maxY = -FLT_MAX;
+    for (j = base; j < base + MESH_BATCH_STRIDE; j++) {
+        float x = batch->screenX[j], y = batch->screenY[j];
+        if (!batch->valid[j]) continue;
+        if (x < b->minX) b->minX = x;
+        if (x > b->maxX) b->maxX = x;
+        if (y < b->minY) b->minY = y;
+        if (y > b->maxY) b->maxY = y;
+    }
+#endif
+}
+
+/* Only the toasters in `order` (the ones that passed cullFlock) are transformed */
+static void transformFlock(const ToasterFlock* flock, VertexBatch* batch,
+                           const DepthKey* order, int count, float pixelScale) {
+    int i, part;
+    
+    buildToasterMatrices(flock, batch, order, count);
+    
+    for (i = 0; i < count; i++) {
+        int t = order[i].index;
+        const Mat34* m = &batch->matrices[t * MESH_PART_COUNT];
+        const MeshSoA* mesh;
+        
+        batch->lod[t] = (BYTE)toasterLod(flock, t, pixelScale);
+        mesh = &g_meshLods[batch->lod[t]].soa;
+        for (part = 0; part < MESH_PART_COUNT; part++) {
+            transformPart(&m[part], mesh, part, flock->x[t], flock->y[t], pixelScale, batch,
+                          t * MESH_BATCH_STRIDE + part * MESH_PART_STRIDE);
+        }
+        boundToaster(batch, t);
+    }
+}
+
+/*
+ * g_lighting indices for one mesh part's view-space vertices at `first`.
+ * Body vertices use the ellipsoid normal (x * 0.3, y, z * 0.5); wings
+ * are flat, so only their height selects a colour.
+ */
+static void lightingIndices(const VertexBatch* batch, int first, BOOL body, int* out) {
+    const Vec3 light = g_lighting.lightDir;
+    int j;
+    
+#if TRANSFORM_LANES > 1
+    vfloat zero = V_ZERO();
+    vfloat one = V_SET1(1.0f);
+    vfloat heightSteps = V_SET1(0.5f * (float)(LIGHT_HEIGHT_STEPS - 1));
+    vfloat heightMax = V_SET1((float)(LIGHT_HEIGHT_STEPS - 1));
+    vfloat ndotlSteps = V_SET1((float)(LIGHT_NDOTL_STEPS - 1));
+    vfloat rowStride = V_SET1((float)LIGHT_HEIGHT_STEPS);
+    vfloat lx = V_SET1(light.x * 0.3f), ly = V_SET1(light.y), lz = V_SET1(light.z * 0.5f);
+    vfloat kx = V_SET1(0.3f * 0.3f), kz = V_SET1(0.5f * 0.5f), tiny = V_SET1(1e-8f);
+    
+    for (j = 0; j < MESH_PART_STRIDE; j += TRANSFORM_LANES) {
+        vfloat y = V_LOAD(batch->viewY + first + j);
+        vfloat h = V_MIN(V_MAX(V_MUL(V_ADD(y, one), heightSteps), zero), heightMax);
+        
+        if (body) {
+            vfloat x = V_LOAD(batch->viewX + first + j);
+            vfloat z = V_LOAD(batch->viewZ + first + j);
+            vfloat len2 = V_ADD(V_ADD(V_MUL(kx, V_MUL(x, x)), V_MUL(y, y)), V_MUL(kz, V_MUL(z, z)));
+            vfloat dot = V_ADD(V_ADD(V_MUL(lx, x), V_MUL(ly, y)), V_MUL(lz, z));
+            vfloat ndotl = V_DIV(dot, V_SQRT(V_MAX(len2, tiny)));
+            vfloat n = V_MIN(V_MAX(V_MUL(ndotl, ndotlSteps), zero), ndotlSteps);
+            h = V_ADD(V_MUL(V_ROUND(n), rowStride), h);
+        }
+        V_STORE_INT(out + j, h);
+    }
+#else
+    for (j = 0; j < MESH_PART_STRIDE; j++) {
+        int k = first + j;
+        float h = (batch->viewY[k] + 1.0f) * 0.5f * (float)(LIGHT_HEIGHT_STEPS - 1);
+        int index;
+        
+        if (h < 0.0f) h = 0.0f;
+        if (h > (float)(LIGHT_HEIGHT_STEPS - 1)) h = (float)(LIGHT_HEIGHT_STEPS - 1);
+        index = (int)(h + 0.5f);
+        
+        if (body) {
+            Vec3 v = { batch->viewX[k], batch->viewY[k], batch->viewZ[k] };
+            Vec3 normal = vec3_normalize((Vec3){ v.x * 0.3f, v.y, v.z * 0.5f });
+            float n = vec3_dot(normal, light) * (float)(LIGHT_NDOTL_STEPS - 1);
+            
+            if (n < 0.0f) n = 0.0f;
+            if (n > (float)(LIGHT_NDOTL_STEPS - 1)) n = (float)(LIGHT_NDOTL_STEPS - 1);
+            index += (int)(n + 0.5f) * LIGHT_HEIGHT_STEPS;
+        }
+        out[j] = index;
+    }
+#endif
+}
+
+static void shadeFlock(const ToasterFlock* flock, VertexBatch* batch,
+                       const DepthKey* order, int count) {
+    DECLSPEC_ALIGN(32) int index[MESH_PART_STRIDE];
+    int n, i;
+    
+    for (n = 0; n < count; n++) {
+        int t = order[n].index;
+        int base = t * MESH_BATCH_STRIDE;
+        int bodyVertices = g_meshLods[batch->lod[t]].soa.partVertexCount[MESH_PART_BODY];
+        int wingBase;
+        
+        lightingIndices(batch, base, TRUE, index);
+        for (i = 0; i < bodyVertices; i++) {
+            batch->colors[base + i] = g_lighting.body[index[i]];
+        }
+        
+        for (wingBase = base + MESH_PART_STRIDE; wingBase < base + MESH_BATCH_STRIDE;
+             wingBase += MESH_PART_STRIDE) {
+            lightingIndices(batch, wingBase, FALSE, index);
+            for (i = 0; i < MESH_PART_STRIDE; i++) {
+                batch->colors[wingBase + i] = g_lighting.wing[index[i]];
+            }
+        }
+    }
+}
+
+static ProjectedPoint batchPoint(const VertexBatch* batch, int k) {
+    ProjectedPoint p;
+    p.x = batch->screenX[k];
+    p.y = batch->screenY[k];
+    p.z = batch->screenZ[k];
+    p.scale = batch->screenScale[k];
+    return p;
+}
+
+/* ============================================
+   DIRTY RECTANGLES
+   ============================================ */
+
+/*
+ * With trails off, only what was drawn last frame needs clearing and only
+ * that plus this frame's drawing needs presenting. Each toaster's bounds
+ * come from its projected vertices; nearby rects merge so a clustered
+ * flock stays a handful of blits.
+ */
+static void markDirtyFull(DirtyRegion* region) {
+    region->full = TRUE;
+    region->count = 0;
+}
+
+static void addDirtyRect(DirtyRegion* region, RECT r, int width, int height) {
+    int i;
+    
+    if (region->full) return;
+    if (r.left < 0) r.left = 0;
+    if (r.top < 0) r.top = 0;
+    if (r.right > width) r.right = width;
+    if (r.bottom > height) r.bottom = height;
+    if (r.left >= r.right || r.top >= r.bottom) return;
+    
+    /* Absorb every rect within the slack; the union may reach further ones */
+    for (i = 0; i < region->count; i++) {
+        RECT* o = &region->rects[i];
+        if (r.left <= o->right + DIRTY_MERGE_SLACK && o->left <= r.right + DIRTY_MERGE_SLACK &&
+            r.top <= o->bottom + DIRTY_MERGE_SLACK && o->top <= r.bottom + DIRTY_MERGE_SLACK) {
+            if (o->left < r.left) r.left = o->left;
+            if (o->top < r.top) r.top = o->top;
+            if (o->right > r.right) r.right = o->right;
+            if (o->bottom > r.bottom) r.bottom = o->bottom;
+            region->rects[i] = region->rects[--region->count];
+            i = -1;
+        }
+    }
+    
+    if (region->count == MAX_DIRTY_RECTS) {
+        markDirtyFull(region);
+        return;
+    }
+    region->rects[region->count++] = r;
+}
+
+/* Large coverage is cheaper as one full clear and blit */
+static void limitDirtyArea(DirtyRegion* region, int width, int height) {
+    LONGLONG area = 0;
+    int i;
+    
+    if (region->full) return;
+    for (i = 0; i < region->count; i++) {
+        const RECT* r = &region->rects[i];
+        area += (LONGLONG)(r->right - r->left) * (r->bottom - r->top);
+    }
+    if (area * 100 > (LONGLONG)width * height * DIRTY_FULL_PERCENT) {
+        markDirtyFull(region);
+    }
+}
+
+/* Screen bounds of each listed toaster's visible vertices, grown by `pad` pixels */
+static void boundFlock(DirtyRegion* region, const VertexBatch* batch, const DepthKey* order,
+                       int count, int pad, int width, int height) {
+    int i;
+    
+    for (i = 0; i < count && !region->full; i++) {
+        const ScreenBounds* b = &batch->bounds[order[i].index];
+        float minX = min(b->minX, (float)width), minY = min(b->minY, (float)height);
+        float maxX = max(b->maxX, 0.0f), maxY = max(b->maxY, 0.0f);
+        RECT r;
+        
+        if (b->maxX < b->minX || maxX < minX || maxY < minY) continue;
+        
+        r.left = (int)floorf(minX) - pad;
+        r.top = (int)floorf(minY) - pad;
+        r.right = (int)ceilf(maxX) + pad + 1;
+        r.bottom = (int)ceilf(maxY) + pad + 1;
+        addDirtyRect(region, r, width, height);
+    }
+}
+
+/*
+ * Everything UI-side this frame draws: the flock plus the HUD. The HUD is
+ * also part of last frame's region, so it's cleared and redrawn in step.
+ */
+static void buildDirtyRegion(DirtyRegion* region, const VertexBatch* batch,
+                             const DepthKey* order, int count, int width, int height) {
+    int pad = g_showGlow ? GLOW_MAX_RADIUS + 1 : MAX_LINE_WIDTH;
+    
+    region->count = 0;
+    region->full = FALSE;
+    boundFlock(region, batch, order, count, pad, width, height);
+    if (g_showStats) {
+        RECT hud = { 0, 0, HUD_WIDTH, HUD_HEIGHT };
+        addDirtyRect(region, hud, width, height);
+    }
+    limitDirtyArea(region, width, height);
+}
+
+/* Last frame's region plus this one's: what changed on screen */
+static void unionDirtyRegion(DirtyRegion* out, const DirtyRegion* a, const DirtyRegion* b,
+                             int width, int height) {
+    int i;
+    
+    *out = *a;
+    if (b->full) markDirtyFull(out);
+    for (i = 0; i < b->count; i++) addDirtyRect(out, b->rects[i], width, height);
+    limitDirtyArea(out, width, height);
+}
+
+/* ============================================
+   TILED RASTERIZER
+   ============================================ */
+
+static int countPhysicalCores(void) {
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info = NULL;
+    DWORD length = 0;
+    int cores = 0;
+    
+    GetLogicalProcessorInformation(NULL, &length);
+    if (length) info = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(length);
+    if (info && GetLogicalProcessorInformation(info, &length)) {
+        DWORD i;
+        for (i = 0; i < length / sizeof(*info); i++) {
+            if (info[i].Relationship == RelationProcessorCore) cores++;
+        }
+    }
+    free(info);
+    
+    if (cores < 1) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        cores = (int)si.dwNumberOfProcessors;
+    }
+    return cores;
+}
+
+static BOOL growArray(void** array, int* capacity, int needed, size_t elemSize) {
+    int newCapacity;
+    void* p;
+    
+    if (needed <= *capacity) return TRUE;
+    newCapacity = *capacity ? *capacity : 256;
+    while (newCapacity < needed) newCapacity *= 2;
+    
+    p = realloc(*array, elemSize * newCapacity);
+    if (!p) return FALSE;
+    *array = p;
+    *capacity = newCapacity;
+    return TRUE;
+}
+
+static void freeEdgeBins(EdgeBins* bins) {
+    free(bins->edges);
+    free(bins->runs);
+    free(bins->bandEdges);
+    free(bins->bandStart);
+    free(bins->bandFill);
+    free(bins->bandAge);
+    ZeroMemory(bins, sizeof(*bins));
+}
+
+static BOOL setupBands(EdgeBins* bins, int height, int threads) {
+    int bandHeight = height / (threads * BANDS_PER_THREAD);
+    int bandCount;
+    int b;
+    
+    if (bandHeight < MIN_BAND_HEIGHT) bandHeight = MIN_BAND_HEIGHT;
+    bandCount = (height + bandHeight - 1) / bandHeight;
+    if (bandCount < 1) bandCount = 1;
+    
+    if (bandCount + 1 > bins->bandCapacity) {
+        int* start = (int*)realloc(bins->bandStart, sizeof(int) * (bandCount + 1));
+        int* fill;
+        float* age;
+        if (!start) return FALSE;
+        bins->bandStart = start;
+        fill = (int*)realloc(bins->bandFill, sizeof(int) * (bandCount + 1));
+        if (!fill) return FALSE;
+        bins->bandFill = fill;
+        age = (float*)realloc(bins->bandAge, sizeof(float) * (bandCount + 1));
+        if (!age) return FALSE;
+        bins->bandAge = age;
+        bins->bandCapacity = bandCount + 1;
+    }
+    bins->bandCount = bandCount;
+    bins->bandHeight = bandHeight;
+    
+    /* New layout: fade everything at least once */
+    for (b = 0; b <= bandCount; b++) bins->bandAge[b] = 0.0f;
+    return TRUE;
+}
+
+/* Pad band ranges (widest pen, or glow radius) so items reach every band they touch */
+static void bandSpan(const EdgeBins* bins, float minY, float maxY, int* first, int* last) {
+    float limit = (float)(bins->bandCount * bins->bandHeight);
+    int top, bottom;
+    
+    /* Clamped before the casts: endpoints near the eye plane can be far outside int range */
+    minY = minY < 0.0f ? 0.0f : minY > limit ? limit : minY;
+    maxY = maxY < 0.0f ? 0.0f : maxY > limit ? limit : maxY;
+    top = (int)minY - bins->pad;
+    bottom = (int)maxY + bins->pad;
+    
+    if (top < 0) top = 0;
+    *first = top / bins->bandHeight;
+    *last = bottom / bins->bandHeight;
+    if (*last >= bins->bandCount) *last = bins->bandCount - 1;
+}
+
+static void edgeBandRange(const EdgeBins* bins, const VertexBatch* batch,
+                          const RasterEdge* e, int* first, int* last) {
+    float ya = batch->screenY[e->v1];
+    float yb = batch->screenY[e->v2];
+    bandSpan(bins, ya < yb ? ya : yb, ya > yb ? ya : yb, first, last);
+}
+
+/*
+ * Close toaster t's run of the items queued since `start`. Its bounds
+ * contain every item, so when they span one band, so does every item.
+ */
+static void closeRun(EdgeBins* bins, const VertexBatch* batch, int t, int start) {
+    BinRun* run;
+    
+    if (bins->edgeCount == start) return;
+    run = &bins->runs[bins->runCount++];
+    run->start = start;
+    run->end = bins->edgeCount;
+    bandSpan(bins, batch->bounds[t].minY, batch->bounds[t].maxY, &run->firstBand, &run->lastBand);
+}
+
+/* One toaster's first edgeCount unified edges whose ends both projected */
+static void queueToasterEdges(EdgeBins* bins, const VertexBatch* batch, const MeshLod* mesh,
+                              int base, int edgeCount) {
+    int i;
+    for (i = 0; i < edgeCount; i++) {
+        int v1 = base + mesh->edges[i].v1;
+        int v2 = base + mesh->edges[i].v2;
+        
+        if (batch->valid[v1] && batch->valid[v2]) {
+            RasterEdge* e = &bins->edges[bins->edgeCount++];
+            e->v1 = v1;
+            e->v2 = v2;
+        }
+    }
+}
+
+/*
+ * Counting-sort the queued items into per-band index lists. Runs inside
+ * a single band go in whole; only toasters straddling bands (and those
+ * partly off the top or bottom) are ranged edge by edge.
+ */
+static BOOL bucketBands(EdgeBins* bins, const VertexBatch* batch) {
+    int r, i, b, total;
+    
+    /* Count pass */
+    for (b = 0; b <= bins->bandCount; b++) bins->bandFill[b] = 0;
+    for (r = 0; r < bins->runCount; r++) {
+        const BinRun* run = &bins->runs[r];
+        
+        if (run->firstBand == run->lastBand) {
+            bins->bandFill[run->firstBand] += run->end - run->start;
+            continue;
+        }
+        for (i = run->start; i < run->end; i++) {
+            int first, last;
+            edgeBandRange(bins, batch, &bins->edges[i], &first, &last);
+            for (b = first; b <= last; b++) bins->bandFill[b]++;
+        }
+    }
+    
+    total = 0;
+    for (b = 0; b < bins->bandCount; b++) {
+        bins->bandStart[b] = total;
+        total += bins->bandFill[b];
+        bins->bandFill[b] = bins->bandStart[b];
+    }
+    bins->bandStart[bins->bandCount] = total;
+    
+    if (!growArray((void**)&bins->bandEdges, &bins->bandEdgeCapacity, total, sizeof(int))) {
+        return FALSE;
+    }
+    
+    /* Fill pass, in queue order so every band keeps painter's order */
+    for (r = 0; r < bins->runCount; r++) {
+        const BinRun* run = &bins->runs[r];
+        
+        if (run->firstBand == run->lastBand) {
+            int* out = &bins->bandEdges[bins->bandFill[run->firstBand]];
+            for (i = run->start; i < run->end; i++) *out++ = i;
+            bins->bandFill[run->firstBand] += run->end - run->start;
+            continue;
+        }
+        for (i = run->start; i < run->end; i++) {
+            int first, last;
+            edgeBandRange(bins, batch, &bins->edges[i], &first, &last);
+            for (b = first; b <= last; b++) bins->bandEdges[bins->bandFill[b]++] = i;
+        }
+    }
+    return TRUE;
+}
+
+static BOOL reserveBins(EdgeBins* bins, int items, int toasters) {
+    bins->edgeCount = 0;
+    bins->runCount = 0;
+    return growArray((void**)&bins->edges, &bins->edgeCapacity, items, sizeof(RasterEdge)) &&
+           growArray((void**)&bins->runs, &bins->runCapacity, toasters, sizeof(BinRun));
+}
+
+/* Collect visible edges back to front, then bucket them by band */
+static BOOL binFlockEdges(EdgeBins* bins, const VertexBatch* batch,
+                          const DepthKey* order, int count, BOOL bracing) {
+    /* The finest level has the most edges */
+    int edgesPerToaster = g_meshLods[0].edgeCount;
+    int i;
+    
+    if (!reserveBins(bins, edgesPerToaster * count, count)) return FALSE;
+    
+    for (i = 0; i < count; i++) {
+        int t = order[i].index;
+        const MeshLod* mesh = &g_meshLods[batch->lod[t]];
+        int start = bins->edgeCount;
+        
+        queueToasterEdges(bins, batch, mesh, t * MESH_BATCH_STRIDE,
+                          bracing ? mesh->edgeCount : mesh->coreEdgeCount);
+        closeRun(bins, batch, t, start);
+    }
+    return bucketBands(bins, batch);
+}
+
+/* Glow points are queued as degenerate v1 == v2 edges in their own bins */
+static BOOL binFlockGlow(EdgeBins* bins, const VertexBatch* batch,
+                         const DepthKey* order, int count) {
+    int i, part, j;
+    
+    if (!reserveBins(bins, MESH_BATCH_STRIDE * count, count)) return FALSE;
+    
+    for (i = 0; i < count; i++) {
+        int t = order[i].index;
+        const MeshSoA* mesh = &g_meshLods[batch->lod[t]].soa;
+        int base = t * MESH_BATCH_STRIDE;
+        int start = bins->edgeCount;
+        
+        for (part = 0; part < MESH_PART_COUNT; part++) {
+            int n = glowVertexCount(mesh, part);
+            for (j = 0; j < n; j++) {
+                int k = base + part * MESH_PART_STRIDE + j;
+                if (batch->valid[k]) {
+                    RasterEdge* e = &bins->edges[bins->edgeCount++];
+                    e->v1 = k;
+                    e->v2 = k;
+                }
+            }
+        }
+        closeRun(bins, batch, t, start);
+    }
+    return bucketBands(bins, batch);
+}
+
+/*
+ * After a frame: reset the age of every band something was drawn into.
+ * A band left alone for TRAIL_SETTLE_TICKS has faded to the background
+ * and the trail pass skips it.
+ */
+static void ageBands(EdgeBins* bins, const EdgeBins* glow, float ticks) {
+    int b;
+    for (b = 0; b < bins->bandCount; b++) {
+        BOOL drawn = bins->bandStart[b + 1] > bins->bandStart[b] ||
+                     (glow && glow->bandStart[b + 1] > glow->bandStart[b]);
+        if (drawn) {
+            bins->bandAge[b] = 0.0f;
+        } else if (bins->bandAge[b] < TRAIL_SETTLE_TICKS) {
+            bins->bandAge[b] += ticks;
+        }
+    }
+}
+
+static void rasterBand(const TileJob* job, int band) {
+    Framebuffer* fb = job->fb;
+    const EdgeBins* bins = job->bins;
+    const VertexBatch* batch = job->batch;
+    int top = band * bins->bandHeight;
+    int bottom = top + bins->bandHeight;
+    int k;
+    
+    if (bottom > fb->height) bottom = fb->height;
+    
+    if (job->pass == TILE_PASS_CLEAR) {
+        if (job->dirty) {
+            for (k = 0; k < job->dirty->count; k++) {
+                fillFramebufferRect(fb, &job->dirty->rects[k], top, bottom, job->clearColor);
+            }
+        } else if (!job->decay) {
+            fillFramebufferRows(fb, top, bottom, job->clearColor);
+        } else if (bins->bandAge[band] < TRAIL_SETTLE_TICKS) {
+            decayFramebufferRows(fb, top, bottom, job->clearColor, job->decay);
+        }
+        return;
+    }
+    
+    if (job->pass == TILE_PASS_SCANLINES) {
+        RECT all = { 0, 0, fb->width, fb->height };
+        if (!job->dirty) {
+            darkenScanlines(fb, &all, top, bottom, job->scanlineSpacing, job->scanlineKeep);
+        }
+        for (k = 0; job->dirty && k < job->dirty->count; k++) {
+            darkenScanlines(fb, &job->dirty->rects[k], top, bottom,
+                            job->scanlineSpacing, job->scanlineKeep);
+        }
+        return;
+    }
+    
+    if (job->pass == TILE_PASS_GLOW) {
+        for (k = bins->bandStart[band]; k < bins->bandStart[band + 1]; k++) {
+            int v = bins->edges[bins->bandEdges[k]].v1;
+            compositeGlow(fb, batchPoint(batch, v), batch->colors[v], top, bottom);
+        }
+        return;
+    }
+    
+    for (k = bins->bandStart[band]; k < bins->bandStart[band + 1]; k++) {
+        const RasterEdge* e = &bins->edges[bins->bandEdges[k]];
+        ProjectedPoint p1 = batchPoint(batch, e->v1), p2 = batchPoint(batch, e->v2);
+        Color c1 = batch->colors[e->v1], c2 = batch->colors[e->v2];
+        
+        /* Against the whole surface, not the band, so every band trims alike */
+        if (!clipLine(&p1, &p2, &c1, &c2, fb->width, fb->height)) continue;
+        drawGradientLineDIB(fb, p1, p2, c1, c2, job->maxLineWidth, top, bottom);
+    }
+}
+
+/* Bands are handed out one at a time so uneven bands balance themselves */
+static void runBands(RenderPool* pool, const TileJob* job) {
+    LONG band;
+    while ((band = InterlockedIncrement(&pool->nextBand) - 1) < job->bins->bandCount) {
+        rasterBand(job, (int)band);
+    }
+}
+
+static DWORD WINAPI renderWorkerProc(LPVOID param) {
+    RenderPool* pool = (RenderPool*)param;
+    
+    for (;;) {
+        WaitForSingleObject(pool->startSemaphore, INFINITE);
+        if (pool->quit) break;
+        
+        runBands(pool, pool->job);
+        
+        if (InterlockedDecrement(&pool->pending) == 0) {
+            SetEvent(pool->doneEvent);
+        }
+    }
+    return 0;
+}
+
+static void createRenderPool(RenderPool* pool, int threads) {
+    int i;
+    
+    ZeroMemory(pool, sizeof(*pool));
+    if (threads > MAX_RENDER_THREADS) threads = MAX_RENDER_THREADS;
+    if (threads <= 1) return;
+    
+    pool->startSemaphore = CreateSemaphoreW(NULL, 0, MAX_RENDER_THREADS, NULL);
+    pool->doneEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!pool->startSemaphore || !pool->doneEvent) return;
+    
+    for (i = 0; i < threads - 1; i++) {
+        HANDLE h = CreateThread(NULL, 0, renderWorkerProc, pool, 0, NULL);
+        if (!h) break;
+        pool->threads[pool->workerCount++] = h;
+    }
+}
+
+static void destroyRenderPool(RenderPool* pool) {
+    int i;
+    
+    if (pool->workerCount) {
+        pool->quit = 1;
+        ReleaseSemaphore(pool->startSemaphore, pool->workerCount, NULL);
+        WaitForMultipleObjects(pool->workerCount, pool->threads, TRUE, INFINITE);
+        for (i = 0; i < pool->workerCount; i++) CloseHandle(pool->threads[i]);
+    }
+    if (pool->startSemaphore) CloseHandle(pool->startSemaphore);
+    if (pool->doneEvent) CloseHandle(pool->doneEvent);
+    ZeroMemory(pool, sizeof(*pool));
+}
+
+/* Rasterize every band; returns once the whole framebuffer is written */
+static void runTileJob(RenderPool* pool, const TileJob* job) {
+    pool->job = job;
+    pool->nextBand = 0;
+    
+    if (pool->workerCount) {
+        pool->pending = pool->workerCount;
+        ReleaseSemaphore(pool->startSemaphore, pool->workerCount, NULL);
+        runBands(pool, job);
+        WaitForSingleObject(pool->doneEvent, INFINITE);
+    } else {
+        runBands(pool, job);
+    }
+}
+
+/* ============================================
+   GPU BACKEND (DIRECT3D 11)
+   ============================================ */
+
+/*
+ * The shared meshes live in immutable buffers; each frame uploads only one
+ * GpuInstance per toaster part, in back-to-front order. Every edge becomes
+ * a screen-space quad expanded in the vertex shader, so the whole flock is
+ * one instanced draw, and primitive order keeps the painter's algorithm.
+ * Shading mirrors lightingColor/shadeFlock, without the table quantization.
+ */
+static const char k_gpuShaderSource[] =
+    "Buffer<float4> g_mesh : register(t0);\n"
+    "Buffer<uint4> g_edges : register(t1);\n"
+    "Buffer<float4> g_instances : register(t2);\n"
+    "Buffer<uint4> g_glowPoints : register(t3);\n"
+    "cbuffer Frame : register(b0) {\n"
+    "    float4 g_viewport;\n"          /* 2 / width, 2 / height, scanline spacing, darkening */
+    "    float4 g_light;\n"            /* light direction, back buffer pixels per window pixel */
+    "};\n"
+    "struct ViewVertex { float3 view; float pz; float2 screen; float scale; };\n"
+    "static const float2 k_lineCorners[6] = {\n"
+    "    float2(0, -1), float2(1, -1), float2(1, 1), float2(0, -1), float2(1, 1), float2(0, 1) };\n"
+    "static const float2 k_quadCorners[6] = {\n"
+    "    float2(-1, -1), float2(1, -1), float2(1, 1), float2(-1, -1), float2(1, 1), float2(-1, 1) };\n"
+    "ViewVertex transformVertex(uint v, uint part, uint instance) {\n"
+    "    uint row = (instance * 3 + part) * 4;\n"
+    "    float4 p = float4(g_mesh[v].xyz, 1.0);\n"
+    "    ViewVertex o;\n"
+    "    o.view = float3(dot(g_instances[row], p), dot(g_instances[row + 1], p),\n"
+    "                    dot(g_instances[row + 2], p));\n"
+    "    o.pz = o.view.z + FOV;\n"
+    "    o.scale = FOV / o.pz * g_light.w;\n"
+    "    o.screen = g_instances[row + 3].xy + float2(o.view.x, -o.view.y) * o.scale;\n"
+    "    return o;\n"
+    "}\n"
+    "float4 toClip(float2 screen, float pz) {\n"
+    "    return float4((screen.x * g_viewport.x - 1.0) * pz, (1.0 - screen.y * g_viewport.y) * pz,\n"
+    "                  0.5 * pz, pz);\n"
+    "}\n"
+    "float3 shade(float3 v, uint part) {\n"
+    "    float3 n = part == 0 ? normalize(float3(v.x * 0.3, v.y, v.z * 0.5)) : float3(0, 1, 0);\n"
+    "    float intensity = 0.3 + 0.7 * saturate(dot(n, g_light.xyz));\n"
+    "    float h = saturate((v.y + 1.0) * 0.5);\n"
+    "    float3 c = lerp(float3(0, 200, 255), float3(255, 100, 255), h) * intensity;\n"
+    "    if (part != 0) c = min(c + float3(100, 50, 0), 255.0);\n"
+    "    return c / 255.0;\n"
+    "}\n"
+    "struct LineOut { float4 pos : SV_Position; noperspective float3 color : COLOR0; };\n"
+    "LineOut LineVS(uint id : SV_VertexID, uint instance : SV_InstanceID) {\n"
+    "    uint4 e = g_edges[id / 6];\n"
+    "    float2 corner = k_lineCorners[id % 6];\n"
+    "    ViewVertex a = transformVertex(e.x, e.z, instance);\n"
+    "    ViewVertex b = transformVertex(e.y, e.z, instance);\n"
+    "    float2 d = b.screen - a.screen;\n"
+    "    float len = length(d);\n"
+    "    float2 dir = len > 0.0001 ? d / len : float2(1, 0);\n"
+    "    float width = floor(clamp((a.scale + b.scale) * 0.4, 1.0, MAX_LINE_WIDTH));\n"
+    "    float2 s = corner.x > 0.5 ? b.screen + dir * (0.5 * width) : a.screen - dir * (0.5 * width);\n"
+    "    LineOut o;\n"
+    "    s += float2(-dir.y, dir.x) * (corner.y * 0.5 * width);\n"
+    "    o.pos = (a.pz > 0.0 && b.pz > 0.0) ? toClip(s, corner.x > 0.5 ? b.pz : a.pz) : 0.0;\n"
+    "    o.color = shade(corner.x > 0.5 ? b.view : a.view, e.z);\n"
+    "    return o;\n"
+    "}\n"
+    "float4 LinePS(LineOut i) : SV_Target { return float4(i.color, 1.0); }\n"
+    "struct GlowOut { float4 pos : SV_Position; float2 uv : TEXCOORD0; nointerpolation float3 color : COLOR0; };\n"
+    "GlowOut GlowVS(uint id : SV_VertexID, uint instance : SV_InstanceID) {\n"
+    "    float2 corner = k_quadCorners[id % 6];\n"
+    "    uint4 g = g_glowPoints[id / 6];\n"
+    "    ViewVertex v = transformVertex(g.x, g.y, instance);\n"
+    "    float radius = clamp(floor(3.0 * v.scale), GLOW_MIN_RADIUS, GLOW_MAX_RADIUS);\n"
+    "    GlowOut o;\n"
+    "    o.pos = v.pz > 0.0 ? toClip(v.screen + corner * radius, v.pz) : 0.0;\n"
+    "    o.uv = corner;\n"
+    "    o.color = shade(v.view, g.y);\n"
+    "    return o;\n"
+    "}\n"
+    "float4 GlowPS(GlowOut i) : SV_Target {\n"
+    "    float fall = 1.0 - length(i.uv);\n"
+    "    clip(fall);\n"
+    "    return float4(lerp(i.color, 1.0, fall) * (0.3 * fall), 1.0);\n"
+    "}\n"
+    "float4 ScreenVS(uint id : SV_VertexID) : SV_Position {\n"
+    "    float2 uv = float2((id << 1) & 2, id & 2);\n"
+    "    return float4(uv * float2(2, -2) + float2(-1, 1), 0, 1);\n"
+    "}\n"
+    "float4 ScanlinePS(float4 pos : SV_Position) : SV_Target {\n"
+    "    if (fmod(floor(pos.y), g_viewport.z) != 0.0) discard;\n"
+    "    return float4(0, 0, 0, g_viewport.w);\n"
+    "}\n"
+    "float4 FadePS(float4 pos : SV_Position) : SV_Target { return 1.0 / 255.0; }\n"
+    "float4 BackgroundPS(float4 pos : SV_Position) : SV_Target { return float4(0, 0, 8.0 / 255.0, 1); }\n";
+
+static void releaseCom(void* obj) {
+    if (obj) IUnknown_Release((IUnknown*)obj);
+}
+
+static ID3DBlob* compileGpuShader(const GpuRenderer* gpu, const char* entry, const char* target) {
+    static const D3D_SHADER_MACRO defines[] = {
+        { "FOV", STRINGIFY(FOV) },
+        { "MAX_LINE_WIDTH", STRINGIFY(MAX_LINE_WIDTH) },
+        { "GLOW_MIN_RADIUS", STRINGIFY(GLOW_MIN_RADIUS) },
+        { "GLOW_MAX_RADIUS", STRINGIFY(GLOW_MAX_RADIUS) },
+        { NULL, NULL }
+    };
+    ID3DBlob* code = NULL;
+    ID3DBlob* errors = NULL;
+    HRESULT hr;
+    
+    hr = gpu->compile(k_gpuShaderSource, sizeof(k_gpuShaderSource) - 1, "flying_toasters.hlsl",
+                      defines, NULL, entry, target, D3DCOMPILE_OPTIMIZATION_LEVEL3, 0,
+                      &code, &errors);
+    if (errors) {
+        OutputDebugStringA((const char*)ID3D10Blob_GetBufferPointer(errors));
+        ID3D10Blob_Release(errors);
+    }
+    if (FAILED(hr)) {
+        releaseCom(code);
+        return NULL;
+    }
+    return code;
+}
+
+static BOOL createGpuVertexShader(GpuRenderer* gpu, const char* entry, ID3D11VertexShader** out) {
+    ID3DBlob* code = compileGpuShader(gpu, entry, "vs_4_0");
+    HRESULT hr;
+    
+    if (!code) return FALSE;
+    hr = ID3D11Device_CreateVertexShader(gpu->device, ID3D10Blob_GetBufferPointer(code),
+                                         ID3D10Blob_GetBufferSize(code), NULL, out);
+    ID3D10Blob_Release(code);
+    return SUCCEEDED(hr);
+}
+
+static BOOL createGpuPixelShader(GpuRenderer* gpu, const char* entry, ID3D11PixelShader** out) {
+    ID3DBlob* code = compileGpuShader(gpu, entry, "ps_4_0");
+    HRESULT hr;
+    
+    if (!code) return FALSE;
+    hr = ID3D11Device_CreatePixelShader(gpu->device, ID3D10Blob_GetBufferPointer(code),
+                                        ID3D10Blob_GetBufferSize(code), NULL, out);
+    ID3D10Blob_Release(code);
+    return SUCCEEDED(hr);
+}
+
+/* A buffer of 16-byte elements seen by the shaders as Buffer<float4/uint4> */
+static BOOL createGpuBuffer(GpuRenderer* gpu, UINT bytes, const void* data, DXGI_FORMAT format,
+                            ID3D11Buffer** buffer, ID3D11ShaderResourceView** view) {
+    D3D11_BUFFER_DESC desc;
+    D3D11_SUBRESOURCE_DATA init;
+    D3D11_SHADER_RESOURCE_VIEW_DESC srv;
+    
+    ZeroMemory(&desc, sizeof(desc));
+    desc.ByteWidth = bytes;
+    desc.Usage = data ? D3D11_USAGE_IMMUTABLE : D3D11_USAGE_DYNAMIC;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    desc.CPUAccessFlags = data ? 0 : D3D11_CPU_ACCESS_WRITE;
+    
+    ZeroMemory(&init, sizeof(init));
+    init.pSysMem = data;
+    
+    if (FAILED(ID3D11Device_CreateBuffer(gpu->device, &desc, data ? &init : NULL, buffer))) {
+        return FALSE;
+    }
+    
+    ZeroMemory(&srv, sizeof(srv));
+    srv.Format = format;
+    srv.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    srv.Buffer.NumElements = bytes / 16;
+    return SUCCEEDED(ID3D11Device_CreateShaderResourceView(gpu->device, (ID3D11Resource*)*buffer,
+                                                           &srv, view));
+}
+
+/* The Frame cbuffer; width and height are the back buffer's */
+static void fillGpuConstants(const GpuRenderer* gpu, float* constants) {
+    constants[0] = 2.0f / (float)gpu->width;
+    constants[1] = 2.0f / (float)gpu->height;
+    constants[2] = (float)g_scanlineSpacing;
+    constants[3] = (float)g_scanlineIntensity / 100.0f;
+    constants[4] = g_lightDir.x;
+    constants[5] = g_lightDir.y;
+    constants[6] = g_lightDir.z;
+    constants[7] = gpu->pixelScale;
+}
+
+/* Upload the shared meshes once; needs createToasterModels to have run */
+static BOOL createGpuMeshes(GpuRenderer* gpu, int capacity) {
+    const MeshLod* mesh = &g_meshLods[g_finestLod > LOD_GPU ? g_finestLod : LOD_GPU];
+    float vertices[MESH_BATCH_STRIDE * 4];
+    UINT edges[MAX_EDGES * MESH_PART_COUNT * 4];
+    UINT glowPoints[MESH_BATCH_STRIDE * 4];
+    float constants[8];
+    D3D11_BUFFER_DESC desc;
+    D3D11_SUBRESOURCE_DATA init;
+    int i, n, part;
+    
+    for (i = 0; i < MESH_BATCH_STRIDE; i++) {
+        vertices[i * 4 + 0] = mesh->soa.x[i];
+        vertices[i * 4 + 1] = mesh->soa.y[i];
+        vertices[i * 4 + 2] = mesh->soa.z[i];
+        vertices[i * 4 + 3] = 1.0f;
+    }
+    
+    /* The unified list, already in prefix order; the shader needs each edge's part */
+    for (n = 0; n < mesh->edgeCount; n++) {
+        edges[n * 4 + 0] = mesh->edges[n].v1;
+        edges[n * 4 + 1] = mesh->edges[n].v2;
+        edges[n * 4 + 2] = mesh->edges[n].v1 / MESH_PART_STRIDE;
+        edges[n * 4 + 3] = 0;
+    }
+    gpu->coreEdgeCount = mesh->coreEdgeCount;
+    gpu->edgeCount = mesh->edgeCount;
+    gpu->capacity = capacity;
+    
+    n = 0;
+    for (part = 0; part < MESH_PART_COUNT; part++) {
+        for (i = 0; i < glowVertexCount(&mesh->soa, part); i++, n++) {
+            glowPoints[n * 4 + 0] = part * MESH_PART_STRIDE + i;
+            glowPoints[n * 4 + 1] = part;
+            glowPoints[n * 4 + 2] = 0;
+            glowPoints[n * 4 + 3] = 0;
+        }
+    }
+    gpu->glowCount = n;
+    
+    if (!createGpuBuffer(gpu, sizeof(vertices), vertices, DXGI_FORMAT_R32G32B32A32_FLOAT,
+                         &gpu->meshBuffer, &gpu->views[0]) ||
+        !createGpuBuffer(gpu, sizeof(UINT) * 4 * gpu->edgeCount, edges,
+                         DXGI_FORMAT_R32G32B32A32_UINT, &gpu->edgeBuffer, &gpu->views[1]) ||
+        !createGpuBuffer(gpu, sizeof(GpuInstance) * MESH_PART_COUNT * capacity, NULL,
+                         DXGI_FORMAT_R32G32B32A32_FLOAT, &gpu->instanceBuffer, &gpu->views[2]) ||
+        !createGpuBuffer(gpu, sizeof(UINT) * 4 * gpu->glowCount, glowPoints,
+                         DXGI_FORMAT_R32G32B32A32_UINT, &gpu->glowBuffer, &gpu->views[3])) {
+        return FALSE;
+    }
+    
+    fillGpuConstants(gpu, constants);
+    
+    /* Default usage: resizeGpuRenderer rewrites it */
+    ZeroMemory(&desc, sizeof(desc));
+    desc.ByteWidth = sizeof(constants);
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    ZeroMemory(&init, sizeof(init));
+    init.pSysMem = constants;
+    return SUCCEEDED(ID3D11Device_CreateBuffer(gpu->device, &desc, &init, &gpu->constants));
+}
+
+/*
+ * Trails fade the persistent back buffer in two passes: dest * factor -
+ * 1/255 (the bias keeps rounding from stranding faint pixels), then max
+ * with the background colour.
+ */
+static BOOL createGpuStates(GpuRenderer* gpu) {
+    D3D11_BLEND_DESC blend;
+    D3D11_BLEND_DESC fade;
+    D3D11_BLEND_DESC fadeFloor;
+    D3D11_BLEND_DESC darken;
+    D3D11_RASTERIZER_DESC raster;
+    
+    ZeroMemory(&blend, sizeof(blend));
+    blend.RenderTarget[0].BlendEnable = TRUE;
+    blend.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+    blend.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+    blend.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+    blend.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ONE;
+    blend.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+    blend.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+    blend.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+    
+    fade = blend;
+    fade.RenderTarget[0].DestBlend = D3D11_BLEND_BLEND_FACTOR;
+    fade.RenderTarget[0].BlendOp = D3D11_BLEND_OP_REV_SUBTRACT;
+    fade.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_BLEND_FACTOR;
+    fade.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_REV_SUBTRACT;
+    
+    fadeFloor = blend;
+    fadeFloor.RenderTarget[0].BlendOp = D3D11_BLEND_OP_MAX;
+    fadeFloor.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_MAX;
+    
+    /* Scanlines: dest * (1 - darkening) */
+    darken = blend;
+    darken.RenderTarget[0].SrcBlend = D3D11_BLEND_ZERO;
+    darken.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
+    
+    ZeroMemory(&raster, sizeof(raster));
+    raster.FillMode = D3D11_FILL_SOLID;
+    raster.CullMode = D3D11_CULL_NONE;
+    raster.DepthClipEnable = TRUE;
+    
+    return SUCCEEDED(ID3D11Device_CreateBlendState(gpu->device, &blend, &gpu->additive)) &&
+           SUCCEEDED(ID3D11Device_CreateBlendState(gpu->device, &fade, &gpu->fade)) &&
+           SUCCEEDED(ID3D11Device_CreateBlendState(gpu->device, &fadeFloor, &gpu->fadeFloor)) &&
+           SUCCEEDED(ID3D11Device_CreateBlendState(gpu->device, &darken, &gpu->darken)) &&
+           SUCCEEDED(ID3D11Device_CreateRasterizerState(gpu->device, &raster, &gpu->raster));
+}
+
+static void destroyGpuRenderer(GpuRenderer* gpu) {
+    int i;
+    
+    if (gpu->context) ID3D11DeviceContext_ClearState(gpu->context);
+    
+    releaseCom(gpu->raster);
+    releaseCom(gpu->darken);
+    releaseCom(gpu->fadeFloor);
+    releaseCom(gpu->fade);
+    releaseCom(gpu->additive);
+    releaseCom(gpu->backgroundPS);
+    releaseCom(gpu->fadePS);
+    releaseCom(gpu->scanlinePS);
+    releaseCom(gpu->glowPS);
+    releaseCom(gpu->linePS);
+    releaseCom(gpu->screenVS);
+    releaseCom(gpu->glowVS);
+    releaseCom(gpu->lineVS);
+    for (i = 0; i < 4; i++) releaseCom(gpu->views[i]);
+    releaseCom(gpu->glowBuffer);
+    releaseCom(gpu->constants);
+    releaseCom(gpu->instanceBuffer);
+    releaseCom(gpu->edgeBuffer);
+    releaseCom(gpu->meshBuffer);
+    releaseCom(gpu->target);
+    releaseCom(gpu->canvas);
+    releaseCom(gpu->swapChain);
+    releaseCom(gpu->context);
+    releaseCom(gpu->device);
+    
+    if (gpu->compiler) FreeLibrary(gpu->compiler);
+    if (gpu->d3d11) FreeLibrary(gpu->d3d11);
+    ZeroMemory(gpu, sizeof(*gpu));
+}
+
+/* The render target: the back buffer itself, or under the flip model a canvas of the same size */
+static BOOL createGpuTarget(GpuRenderer* gpu) {
+    ID3D11Texture2D* backBuffer = NULL;
+    HRESULT hr;
+    
+    if (FAILED(IDXGISwapChain_GetBuffer(gpu->swapChain, 0, &IID_ID3D11Texture2D,
+                                        (void**)&backBuffer))) {
+        return FALSE;
+    }
+    if (gpu->flip) {
+        D3D11_TEXTURE2D_DESC desc;
+        
+        ID3D11Texture2D_GetDesc(backBuffer, &desc);
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET;
+        desc.CPUAccessFlags = 0;
+        desc.MiscFlags = 0;
+        ID3D11Texture2D_Release(backBuffer);
+        backBuffer = NULL;
+        if (FAILED(ID3D11Device_CreateTexture2D(gpu->device, &desc, NULL, &gpu->canvas))) {
+            return FALSE;
+        }
+        hr = ID3D11Device_CreateRenderTargetView(gpu->device, (ID3D11Resource*)gpu->canvas, NULL,
+                                                 &gpu->target);
+        return SUCCEEDED(hr);
+    }
+    hr = ID3D11Device_CreateRenderTargetView(gpu->device, (ID3D11Resource*)backBuffer, NULL,
+                                             &gpu->target);
+    ID3D11Texture2D_Release(backBuffer);
+    return SUCCEEDED(hr);
+}
+
+/*
+ * Hardware device and swap chain. flipOnly is for the software backends'
+ * presenter, which has no reason to exist without the flip model.
+ */
+static BOOL createGpuSwapChain(GpuRenderer* gpu, HWND hWnd, int width, int height,
+                               float pixelScale, BOOL flipOnly) {
+    static const D3D_FEATURE_LEVEL levels[] = {
+        D3D_FEATURE_LEVEL_11_0, D3D_FEATURE_LEVEL_10_1, D3D_FEATURE_LEVEL_10_0
+    };
+    PFN_D3D11_CREATE_DEVICE_AND_SWAP_CHAIN createDevice;
+    DXGI_SWAP_CHAIN_DESC desc;
+    HRESULT hr;
+    
+    ZeroMemory(gpu, sizeof(*gpu));
+    if (!hWnd) return FALSE;
+    
+    gpu->width = width < 1 ? 1 : width;
+    gpu->height = height < 1 ? 1 : height;
+    gpu->pixelScale = pixelScale;
+    
+    if (flipOnly && !g_composited) return FALSE;
+    gpu->d3d11 = LoadLibraryA("d3d11.dll");
+    if (!gpu->d3d11) return FALSE;
+    createDevice = (PFN_D3D11_CREATE_DEVICE_AND_SWAP_CHAIN)
+        GetProcAddress(gpu->d3d11, "D3D11CreateDeviceAndSwapChain");
+    if (!createDevice) return FALSE;
+    
+    /* GDI-compatible BGRA back buffer so the stats HUD can still use TextOut */
+    ZeroMemory(&desc, sizeof(desc));
+    desc.BufferDesc.Width = gpu->width;
+    desc.BufferDesc.Height = gpu->height;
+    desc.BufferDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+    desc.OutputWindow = hWnd;
+    desc.Windowed = TRUE;
+    desc.Flags = DXGI_SWAP_CHAIN_FLAG_GDI_COMPATIBLE;
+    
+    /*
+     * Under composition DWM takes flipped buffers as they are, without
+     * the copy a blit-model present costs it. Before Windows 8, or with
+     * composition off, the flip model is refused: fall back to blitting.
+     */
+    gpu->flip = g_composited;
+    for (;;) {
+        desc.BufferCount = gpu->flip ? 2 : 1;
+        desc.SwapEffect = gpu->flip ? DXGI_SWAP_EFFECT_FLIP_SEQUENTIAL
+                                    : DXGI_SWAP_EFFECT_SEQUENTIAL;     /* trails fade the last frame */
+        hr = createDevice(NULL, D3D_DRIVER_TYPE_HARDWARE, NULL, D3D11_CREATE_DEVICE_BGRA_SUPPORT,
+                          levels, sizeof(levels) / sizeof(levels[0]), D3D11_SDK_VERSION, &desc,
+                          &gpu->swapChain, &gpu->device, NULL, &gpu->context);
+        if (SUCCEEDED(hr) || !gpu->flip || flipOnly) break;
+        gpu->flip = FALSE;
+    }
+    return SUCCEEDED(hr) && createGpuTarget(gpu);
+}
+
+/*
+ * Hardware device only: when there is no D3D11 adapter (or no shader
+ * compiler) the caller falls back to the software rasterizer.
+ */
+static BOOL createGpuRenderer(GpuRenderer* gpu, HWND hWnd, int width, int height,
+                              float pixelScale, int capacity) {
+    if (!createGpuSwapChain(gpu, hWnd, width, height, pixelScale, FALSE)) return FALSE;
+    
+    gpu->compiler = LoadLibraryA("d3dcompiler_47.dll");
+    if (!gpu->compiler) gpu->compiler = LoadLibraryA("d3dcompiler_43.dll");
+    if (!gpu->compiler) return FALSE;
+    gpu->compile = (pD3DCompile)GetProcAddress(gpu->compiler, "D3DCompile");
+    if (!gpu->compile) return FALSE;
+    
+    return createGpuVertexShader(gpu, "LineVS", &gpu->lineVS) &&
+           createGpuVertexShader(gpu, "GlowVS", &gpu->glowVS) &&
+           createGpuVertexShader(gpu, "ScreenVS", &gpu->screenVS) &&
+           createGpuPixelShader(gpu, "LinePS", &gpu->linePS) &&
+           createGpuPixelShader(gpu, "GlowPS", &gpu->glowPS) &&
+           createGpuPixelShader(gpu, "ScanlinePS", &gpu->scanlinePS) &&
+           createGpuPixelShader(gpu, "FadePS", &gpu->fadePS) &&
+           createGpuPixelShader(gpu, "BackgroundPS", &gpu->backgroundPS) &&
+           createGpuMeshes(gpu, capacity) &&
+           createGpuStates(gpu);
+}
+
+/*
+ * Resize the swap chain buffers for a new render scale. The old buffers
+ * (and the trail history in them) go; on failure DXGI keeps them, so the
+ * renderer carries on at the old size.
+ */
+static BOOL resizeGpuRenderer(GpuRenderer* gpu, int width, int height, float pixelScale) {
+    float constants[8];
+    HRESULT hr;
+    
+    ID3D11DeviceContext_OMSetRenderTargets(gpu->context, 0, NULL, NULL);
+    releaseCom(gpu->target);
+    releaseCom(gpu->canvas);
+    gpu->target = NULL;
+    gpu->canvas = NULL;
+    
+    hr = IDXGISwapChain_ResizeBuffers(gpu->swapChain, gpu->flip ? 2 : 1, width, height,
+                                      DXGI_FORMAT_B8G8R8A8_UNORM,
+                                      DXGI_SWAP_CHAIN_FLAG_GDI_COMPATIBLE);
+    if (!createGpuTarget(gpu)) return FALSE;
+    if (FAILED(hr)) return FALSE;
+    
+    gpu->width = width;
+    gpu->height = height;
+    gpu->pixelScale = pixelScale;
+    gpu->primed = FALSE;
+    if (gpu->constants) {
+        fillGpuConstants(gpu, constants);
+        ID3D11DeviceContext_UpdateSubresource(gpu->context, (ID3D11Resource*)gpu->constants, 0,
+                                              NULL, constants, 0, 0);
+    }
+    return TRUE;
+}
+
+/* decay: 0 clears, else the trail fade factor in 1/256ths */
+static void gpuBeginFrame(GpuRenderer* gpu, int decay) {
+    /* RGB(0, 0, 8), the software clear colour */
+    static const float clearColor[4] = { 0.0f, 0.0f, 8.0f / 255.0f, 1.0f };
+    ID3D11DeviceContext* ctx = gpu->context;
+    D3D11_VIEWPORT vp;
+    float factor[4];
+    
+    vp.TopLeftX = 0.0f;
+    vp.TopLeftY = 0.0f;
+    vp.Width = (float)gpu->width;
+    vp.Height = (float)gpu->height;
+    vp.MinDepth = 0.0f;
+    vp.MaxDepth = 1.0f;
+    
+    gpu->resolved = FALSE;
+    ID3D11DeviceContext_OMSetRenderTargets(ctx, 1, &gpu->target, NULL);
+    ID3D11DeviceContext_RSSetViewports(ctx, 1, &vp);
+    ID3D11DeviceContext_RSSetState(ctx, gpu->raster);
+    ID3D11DeviceContext_IASetInputLayout(ctx, NULL);
+    ID3D11DeviceContext_IASetPrimitiveTopology(ctx, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    ID3D11DeviceContext_VSSetConstantBuffers(ctx, 0, 1, &gpu->constants);
+    ID3D11DeviceContext_PSSetConstantBuffers(ctx, 0, 1, &gpu->constants);
+    
+    if (!decay || !gpu->primed) {
+        ID3D11DeviceContext_ClearRenderTargetView(ctx, gpu->target, clearColor);
+        gpu->primed = TRUE;
+        return;
+    }
+    
+    factor[0] = factor[1] = factor[2] = factor[3] = (float)decay / 256.0f;
+    ID3D11DeviceContext_VSSetShader(ctx, gpu->screenVS, NULL, 0);
+    ID3D11DeviceContext_OMSetBlendState(ctx, gpu->fade, factor, 0xffffffff);
+    ID3D11DeviceContext_PSSetShader(ctx, gpu->fadePS, NULL, 0);
+    ID3D11DeviceContext_Draw(ctx, 3, 0);
+    ID3D11DeviceContext_OMSetBlendState(ctx, gpu->fadeFloor, factor, 0xffffffff);
+    ID3D11DeviceContext_PSSetShader(ctx, gpu->backgroundPS, NULL, 0);
+    ID3D11DeviceContext_Draw(ctx, 3, 0);
+    ID3D11DeviceContext_OMSetBlendState(ctx, NULL, factor, 0xffffffff);
+}
+
+/* Instances go up in `order`, so later (nearer) toasters draw on top */
+static void gpuUploadFlock(GpuRenderer* gpu, const ToasterFlock* flock, const VertexBatch* batch,
+                           const DepthKey* order, int count) {
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    GpuInstance* dst;
+    int i, part;
+    
+    if (FAILED(ID3D11DeviceContext_Map(gpu->context, (ID3D11Resource*)gpu->instanceBuffer, 0,
+                                       D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        return;
+    }
+    
+    dst = (GpuInstance*)mapped.pData;
+    for (i = 0; i < count; i++) {
+        int t = order[i].index;
+        for (part = 0; part < MESH_PART_COUNT; part++, dst++) {
+            dst->matrix = batch->matrices[t * MESH_PART_COUNT + part];
+            dst->centerX = flock->x[t] * gpu->pixelScale;
+            dst->centerY = flock->y[t] * gpu->pixelScale;
+            dst->pad[0] = 0.0f;
+            dst->pad[1] = 0.0f;
+        }
+    }
+    
+    ID3D11DeviceContext_Unmap(gpu->context, (ID3D11Resource*)gpu->instanceBuffer, 0);
+}
+
+static void gpuDrawEdges(GpuRenderer* gpu, int count, BOOL bracing) {
+    ID3D11DeviceContext* ctx = gpu->context;
+    int edges = bracing ? gpu->edgeCount : gpu->coreEdgeCount;
+    
+    ID3D11DeviceContext_VSSetShader(ctx, gpu->lineVS, NULL, 0);
+    ID3D11DeviceContext_VSSetShaderResources(ctx, 0, 4, gpu->views);
+    ID3D11DeviceContext_PSSetShader(ctx, gpu->linePS, NULL, 0);
+    ID3D11DeviceContext_DrawInstanced(ctx, edges * 6, count, 0, 0);
+}
+
+static void gpuDrawGlow(GpuRenderer* gpu, int count) {
+    static const float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    ID3D11DeviceContext* ctx = gpu->context;
+    
+    ID3D11DeviceContext_OMSetBlendState(ctx, gpu->additive, blendFactor, 0xffffffff);
+    ID3D11DeviceContext_VSSetShader(ctx, gpu->glowVS, NULL, 0);
+    ID3D11DeviceContext_PSSetShader(ctx, gpu->glowPS, NULL, 0);
+    ID3D11DeviceContext_DrawInstanced(ctx, gpu->glowCount * 6, count, 0, 0);
+    ID3D11DeviceContext_OMSetBlendState(ctx, NULL, blendFactor, 0xffffffff);
+}
+
+static void gpuDrawScanlines(GpuRenderer* gpu) {
+    static const float blendFactor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    ID3D11DeviceContext* ctx = gpu->context;
+    
+    ID3D11DeviceContext_OMSetBlendState(ctx, gpu->darken, blendFactor, 0xffffffff);
+    ID3D11DeviceContext_VSSetShader(ctx, gpu->screenVS, NULL, 0);
+    ID3D11DeviceContext_PSSetShader(ctx, gpu->scanlinePS, NULL, 0);
+    ID3D11DeviceContext_Draw(ctx, 3, 0);
+    ID3D11DeviceContext_OMSetBlendState(ctx, NULL, blendFactor, 0xffffffff);
+}
+
+/* Flip model: copy the finished canvas into the back buffer, once per frame */
+static void gpuResolve(GpuRenderer* gpu) {
+    ID3D11Texture2D* backBuffer = NULL;
+    
+    if (!gpu->canvas || gpu->resolved) return;
+    gpu->resolved = TRUE;
+    if (SUCCEEDED(IDXGISwapChain_GetBuffer(gpu->swapChain, 0, &IID_ID3D11Texture2D,
+                                           (void**)&backBuffer))) {
+        ID3D11DeviceContext_CopyResource(gpu->context, (ID3D11Resource*)backBuffer,
+                                         (ID3D11Resource*)gpu->canvas);
+        ID3D11Texture2D_Release(backBuffer);
+    }
+}
+
+/*
+ * Software backends under the flip model: copy the rects this frame
+ * changed (NULL = all of it) from the DIB into the canvas, which still
+ * holds every earlier upload, so gpuPresent can resolve and flip it.
+ */
+static void gpuUploadFramebuffer(GpuRenderer* gpu, const Framebuffer* fb, const DirtyRegion* dirty) {
+    int count = dirty ? dirty->count : 1;
+    int i;
+    
+    gpu->resolved = FALSE;
+    for (i = 0; i < count; i++) {
+        D3D11_BOX box;
+        RECT r;
+        
+        if (dirty) {
+            r = dirty->rects[i];
+        } else {
+            SetRect(&r, 0, 0, fb->width, fb->height);
+        }
+        
+        /* The DIB may run a block past the swap chain; DXGI stretches only the latter */
+        if (r.right > gpu->width) r.right = gpu->width;
+        if (r.bottom > gpu->height) r.bottom = gpu->height;
+        if (r.left >= r.right || r.top >= r.bottom) continue;
+        
+        box.left = (UINT)r.left;
+        box.top = (UINT)r.top;
+        box.front = 0;
+        box.right = (UINT)r.right;
+        box.bottom = (UINT)r.bottom;
+        box.back = 1;
+        ID3D11DeviceContext_UpdateSubresource(gpu->context, (ID3D11Resource*)gpu->canvas, 0, &box,
+                                              fb->pixels + r.top * fb->pitch + r.left,
+                                              (UINT)(fb->pitch * sizeof(DWORD)), 0);
+    }
+}
+
+/* The back buffer is GDI-compatible; it must be unbound while the DC is out */
+static void gpuDrawHud(GpuRenderer* gpu, const FrameProfiler* prof, int quality) {
+    IDXGISurface1* surface = NULL;
+    HDC hdc;
+    
+    ID3D11DeviceContext_OMSetRenderTargets(gpu->context, 0, NULL, NULL);
+    gpuResolve(gpu);
+    if (FAILED(IDXGISwapChain_GetBuffer(gpu->swapChain, 0, &IID_IDXGISurface1,
+                                        (void**)&surface))) {
+        return;
+    }
+    if (SUCCEEDED(IDXGISurface1_GetDC(surface, FALSE, &hdc))) {
+        drawProfilerHud(hdc, prof, quality);
+        IDXGISurface1_ReleaseDC(surface, NULL);
+    }
+    IDXGISurface1_Release(surface);
+}
+
+/*
+ * Returns the latest present latency in ms, or -1 when unknown. Under the
+ * flip model that is Present to the vblank the frame went out on, from
+ * DXGI's frame statistics (which trail a frame or two); in blit mode
+ * DXGI offers none, and the call's own cost is the present phase.
+ */
+static float gpuPresent(GpuRenderer* gpu, LONGLONG frequency) {
+    DXGI_FRAME_STATISTICS stats;
+    LONGLONG elapsed;
+    UINT id;
+    int slot;
+    
+    gpuResolve(gpu);
+    
+    /* Frame pacing and vsync stay with the frame loop (DwmFlush) */
+    IDXGISwapChain_Present(gpu->swapChain, 0, 0);
+    if (!gpu->flip) return -1.0f;
+    
+    if (SUCCEEDED(IDXGISwapChain_GetLastPresentCount(gpu->swapChain, &id))) {
+        gpu->submittedId[id % PRESENT_LATENCY_RING] = id;
+        gpu->submitted[id % PRESENT_LATENCY_RING] = qpcNow();
+    }
+    if (FAILED(IDXGISwapChain_GetFrameStatistics(gpu->swapChain, &stats))) return -1.0f;
+    
+    slot = stats.PresentCount % PRESENT_LATENCY_RING;
+    if (gpu->submittedId[slot] != stats.PresentCount || !gpu->submitted[slot] ||
+        stats.SyncQPCTime.QuadPart < gpu->submitted[slot]) {
+        return -1.0f;
+    }
+    elapsed = stats.SyncQPCTime.QuadPart - gpu->submitted[slot];
+    gpu->submitted[slot] = 0;   /* statistics repeat until the next vblank present */
+    return (float)((double)elapsed * 1000.0 / (double)frequency);
+}
+
+/* ============================================
+   RENDER SCALE AND ADAPTIVE QUALITY
+   ============================================ */
+
+/*
+ * RenderScale choices, largest first. The back buffer is this fraction of
+ * the window; quality and power-saver steps scale it down from there.
+ */
+static const struct {
+    const char* label;
+    int percent;
+    int num, den;
+} k_renderScales[] = {
+    { "100% (native)", 100, 1, 1 },
+    { "75%",           75,  3, 4 },
+    { "66%",           66,  2, 3 },
+    { "50%",           50,  1, 2 }
+};
+#define RENDER_SCALE_CHOICES (int)(sizeof(k_renderScales) / sizeof(k_renderScales[0]))
+
+/* The largest choice not above `percent`; anything below 50% gets 50% */
+static int findRenderScale(int percent) {
+    int i;
+    for (i = 0; i < RENDER_SCALE_CHOICES - 1; i++) {
+        if (k_renderScales[i].percent <= percent) break;
+    }
+    return i;
+}
+
+/* Cheapest last. The GPU backend draws full-width lines regardless. */
+static const QualityLevel k_qualityLevels[] = {
+    /* glow   bracing  line width       count  resolution */
+    { TRUE,  TRUE,  MAX_LINE_WIDTH, 100,   1, 1 },
+    { FALSE, TRUE,  MAX_LINE_WIDTH, 100,   1, 1 },
+    { FALSE, FALSE, MAX_LINE_WIDTH, 100,   1, 1 },
+    { FALSE, FALSE, 1,              100,   1, 1 },
+    { FALSE, FALSE, 1,              50,    1, 1 },
+    { FALSE, FALSE, 1,              50,    3, 4 },
+    { FALSE, FALSE, 1,              50,    1, 2 }
+};
+
+#define QUALITY_LEVELS      (int)(sizeof(k_qualityLevels) / sizeof(k_qualityLevels[0]))
+#define PREVIEW_QUALITY     3   /* no glow or bracing, 1 px lines, the whole flock */
+
+static void initQualityGovernor(QualityGovernor* gov) {
+    ZeroMemory(gov, sizeof(*gov));
+    gov->raiseAfter = QUALITY_RAISE_WINDOWS;
+    gov->sinceRaise = QUALITY_MAX_RAISE_WINDOWS;
+}
+
+/* The pacing interval a frame has to fit in; uncapped frames aim for 60 fps */
+static float qualityBudgetMs(const Scene* scene) {
+    int fps = g_targetFps;
+    if (g_vsync || !fps) fps = scene->refreshHz ? scene->refreshHz : DEFAULT_TARGET_FPS;
+    if (g_powerState == POWER_SAVER && fps > POWER_SAVER_FPS) fps = POWER_SAVER_FPS;
+    return 1000.0f / (float)fps;
+}
+
+/*
+ * Back buffer extent for a window extent at num/den, kept a multiple of
+ * num so presentScaled maps whole blocks of back buffer pixels onto whole
+ * window pixels.
+ */
+static int scaledExtent(int size, int num, int den) {
+    return ((size * num + den - 1) / den + num - 1) / num * num;
+}
+
+/*
+ * The configured render scale times the quality level's, halved again in
+ * power-saver mode if that's still above 1/2. Reduced to lowest terms so
+ * the block alignment stays small.
+ */
+static void sceneTargetScale(const Scene* scene, int* num, int* den) {
+    const QualityLevel* q = &k_qualityLevels[scene->quality.level];
+    int r = findRenderScale(g_renderScale);
+    int n = k_renderScales[r].num * q->scaleNum;
+    int d = k_renderScales[r].den * q->scaleDen;
+    int a, b;
+    
+    if (g_powerState == POWER_SAVER && n * 2 > d) {
+        n = 1;
+        d = 2;
+    }
+    
+    a = n;
+    b = d;
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    *num = n / a;
+    *den = d / a;
+}
+
+/*
+ * Reallocate the back buffer at num/den of the scene's size: the DIB and
+ * its bands, or the GPU swap chain (which DXGI stretches to the window,
+ * so it needs no block alignment). Leaves the scene as it was on failure,
+ * except that a flip presenter which can't follow gives way to BitBlt.
+ */
+static BOOL setSceneResolution(Scene* scene, int num, int den) {
+    Framebuffer next;
+    int threads = scene->pool.workerCount + 1;
+    int width = scaledExtent(scene->width, num, den);
+    int height = scaledExtent(scene->height, num, den);
+    
+    if (g_rasterBackend == RASTER_GPU) {
+        if (!resizeGpuRenderer(&scene->gpu, (scene->width * num + den - 1) / den,
+                               (scene->height * num + den - 1) / den,
+                               (float)num / (float)den)) {
+            return FALSE;
+        }
+        scene->scaleNum = num;
+        scene->scaleDen = den;
+        return TRUE;
+    }
+    
+    if (!createFramebuffer(&next, NULL, width, height)) return FALSE;
+    if (!setupBands(&scene->bins, height, threads) ||
+        !setupBands(&scene->glowBins, height, threads)) {
+        /* The old layout needs no more memory than it already has */
+        setupBands(&scene->bins, scene->fb.height, threads);
+        setupBands(&scene->glowBins, scene->fb.height, threads);
+        destroyFramebuffer(&next);
+        return FALSE;
+    }
+    
+    fillFramebuffer(&next, 0x000008);
+    destroyFramebuffer(&scene->fb);
+    scene->fb = next;
+    scene->scaleNum = num;
+    scene->scaleDen = den;
+    markDirtyFull(&scene->dirty);
+    
+    if (scene->gpu.swapChain &&
+        !resizeGpuRenderer(&scene->gpu, (scene->width * num + den - 1) / den,
+                           (scene->height * num + den - 1) / den, (float)num / (float)den)) {
+        destroyGpuRenderer(&scene->gpu);
+    }
+    return TRUE;
+}
+
+/* Before each frame, so quality and power changes reach the back buffer */
+static void applySceneResolution(Scene* scene) {
+    int num, den;
+    
+    sceneTargetScale(scene, &num, &den);
+    if (num != scene->scaleNum || den != scene->scaleDen) {
+        setSceneResolution(scene, num, den);
+    }
+}
+
+static void setQualityLevel(Scene* scene, int level) {
+    const QualityLevel* q = &k_qualityLevels[level];
+    ToasterFlock* flock = &scene->flock;
+    
+    scene->quality.level = level;
+    flock->count = flock->total * q->countPercent / 100;
+    if (flock->count < 1) flock->count = 1;
+}
+
+/* Once per frame, after profileEndFrame has pushed the frame's timings */
+static void governQuality(Scene* scene) {
+    QualityGovernor* gov = &scene->quality;
+    const FrameProfiler* prof = &scene->profiler;
+    int last = (prof->historyPos + PROFILE_WINDOW - 1) % PROFILE_WINDOW;
+    int lowest = QUALITY_LEVELS - 1;
+    float budget = qualityBudgetMs(scene);
+    float avg;
+    
+    gov->windowMs += prof->history[PHASE_FRAME][last];
+    if (++gov->windowFrames < QUALITY_WINDOW) return;
+    avg = gov->windowMs / (float)gov->windowFrames;
+    gov->windowMs = 0.0f;
+    gov->windowFrames = 0;
+    
+    /* A step up that has held this long earns back the short wait */
+    if (gov->sinceRaise < QUALITY_MAX_RAISE_WINDOWS &&
+        ++gov->sinceRaise == QUALITY_MAX_RAISE_WINDOWS) {
+        gov->raiseAfter = QUALITY_RAISE_WINDOWS;
+    }
+    
+    if (avg * 100.0f > budget * QUALITY_LOWER_PERCENT) {
+        gov->calmWindows = 0;
+        if (gov->level == lowest) return;
+        
+        /* The last step up didn't hold: wait twice as long before the next */
+        if (gov->sinceRaise <= 1 && gov->raiseAfter < QUALITY_MAX_RAISE_WINDOWS) {
+            gov->raiseAfter *= 2;
+        }
+        setQualityLevel(scene, gov->level + 1);
+    } else if (avg * 100.0f < budget * QUALITY_RAISE_PERCENT && gov->level > 0) {
+        if (++gov->calmWindows < gov->raiseAfter) return;
+        gov->calmWindows = 0;
+        gov->sinceRaise = 0;
+        setQualityLevel(scene, gov->level - 1);
+    } else {
+        gov->calmWindows = 0;
+    }
+}
+
+/* Grow a back buffer rect outward to whole num x num blocks, as presentScaled sends it */
+static void snapToScaleBlocks(RECT* r, int num) {
+    r->left = r->left / num * num;
+    r->top = r->top / num * num;
+    r->right = (r->right + num - 1) / num * num;
+    r->bottom = (r->bottom + num - 1) / num * num;
+}
+
+/* What a present sends, in KB of 32 bpp window pixels; NULL = the whole scene */
+static float presentedKB(const Scene* scene, const DirtyRegion* dirty) {
+    int num = scene->scaleNum, den = scene->scaleDen;
+    double pixels = 0.0;
+    int i;
+    
+    if (!dirty) return (float)((double)scene->width * scene->height * 4.0 / 1024.0);
+    for (i = 0; i < dirty->count; i++) {
+        RECT r = dirty->rects[i];
+        int left, top, right, bottom;
+        
+        /* The window rect presentScaled blits, inside its clip to the scene */
+        if (num != den) snapToScaleBlocks(&r, num);
+        left = r.left * den / num;
+        top = r.top * den / num;
+        right = left + (r.right - r.left) * den / num;
+        bottom = top + (r.bottom - r.top) * den / num;
+        if (right > scene->width) right = scene->width;
+        if (bottom > scene->height) bottom = scene->height;
+        if (right > left && bottom > top) pixels += (double)(right - left) * (double)(bottom - top);
+    }
+    return (float)(pixels * 4.0 / 1024.0);
+}
+
+/*
+ * Remote sessions: cut what is about to be sent to REMOTE_COLOR_MASK.
+ * Gradients and glow falloff then come out as runs of at most 4096
+ * colours, which the RDP / ICA bitmap codecs compress far better than
+ * 24-bit ramps. Trails are off there, so nothing rereads the result.
+ */
+static void quantizeForRemote(Framebuffer* fb, const DirtyRegion* dirty) {
+    int count = dirty ? dirty->count : 1;
+    int i, x, y;
+    
+    for (i = 0; i < count; i++) {
+        RECT r;
+        if (dirty) {
+            r = dirty->rects[i];
+        } else {
+            SetRect(&r, 0, 0, fb->width, fb->height);
+        }
+        for (y = r.top; y < r.bottom; y++) {
+            DWORD* row = fb->pixels + y * fb->pitch;
+            for (x = r.left; x < r.right; x++) row[x] &= REMOTE_COLOR_MASK;
+        }
+    }
+}
+
+/*
+ * StretchBlt the reduced back buffer up to window pixels, whole or one
+ * dirty rect at a time. Rects snap outward to whole num x num blocks so a
+ * partial present samples exactly like a full one; the clip keeps the
+ * rounded-up far edge off any neighbouring scene.
+ */
+static void presentScaled(Scene* scene, HDC hdc, const DirtyRegion* dirty) {
+    const Framebuffer* fb = &scene->fb;
+    int num = scene->scaleNum, den = scene->scaleDen;
+    int count = dirty ? dirty->count : 1;
+    int saved = SaveDC(hdc);
+    int i;
+    
+    IntersectClipRect(hdc, scene->origin.x, scene->origin.y,
+                      scene->origin.x + scene->width, scene->origin.y + scene->height);
+    SetStretchBltMode(hdc, COLORONCOLOR);
+    
+    for (i = 0; i < count; i++) {
+        RECT r;
+        if (dirty) {
+            r = dirty->rects[i];
+        } else {
+            SetRect(&r, 0, 0, fb->width, fb->height);
+        }
+        snapToScaleBlocks(&r, num);
+        
+        StretchBlt(hdc, scene->origin.x + r.left * den / num, scene->origin.y + r.top * den / num,
+                   (r.right - r.left) * den / num, (r.bottom - r.top) * den / num,
+                   fb->dc, r.left, r.top, r.right - r.left, r.bottom - r.top, SRCCOPY);
+    }
+    RestoreDC(hdc, saved);
+}
+
+#ifndef FT_BENCHMARK
+/*
+ * WM_PAINT: put the last finished frame back on screen without waiting
+ * for the render thread. FALSE while a frame is in flight, before the
+ * first one has finished, or when a swap chain owns the window (only its
+ * own Present reaches the screen); the caller then asks for a full present.
+ */
+static BOOL repaintScene(Scene* scene, HDC hdc) {
+    const Framebuffer* fb = &scene->fb;
+    BOOL presented = FALSE;
+    
+    if (!TryEnterCriticalSection(&scene->presentLock)) return FALSE;
+    if (scene->profiler.frameIndex && !scene->gpu.swapChain) {
+        if (scene->scaleNum != scene->scaleDen) {
+            presentScaled(scene, hdc, NULL);
+        } else {
+            BitBlt(hdc, scene->origin.x, scene->origin.y, fb->width, fb->height,
+                   fb->dc, 0, 0, SRCCOPY);
+        }
+        profilePresented(&scene->profiler);
+        presented = TRUE;
+    }
+    LeaveCriticalSection(&scene->presentLock);
+    return presented;
+}
+#endif
+
+/* ============================================
+   TOASTER RENDERING
+   ============================================ */
+
+static void freeGdiLines(GdiLineBatch* lines) {
+    free(lines->runs);
+    free(lines->points);
+    free(lines->counts);
+    ZeroMemory(lines, sizeof(*lines));
+}
+
+static BOOL addGdiRun(GdiLineBatch* lines, int x0, int y0, int x1, int y1, int key, int width) {
+    GdiRun* run;
+    
+    if (!growArray((void**)&lines->runs, &lines->runCapacity, lines->runCount + 1, sizeof(GdiRun))) {
+        return FALSE;
+    }
+    run = &lines->runs[lines->runCount++];
+    run->from.x = x0;
+    run->from.y = y0;
+    run->to.x = x1;
+    run->to.y = y1;
+    run->key = key;
+    run->width = width;
+    return TRUE;
+}
+
+/*
+ * Bresenham with colour interpolation, cut into one run wherever the
+ * quantized colour changes. Runs stop short of their end pixel like
+ * LineTo, and so does the line, so a corner is drawn by the edges that
+ * start there instead of once more by every edge that ends at it.
+ */
+static BOOL queueGdiLine(GdiLineBatch* lines, const Framebuffer* fb, ProjectedPoint p1,
+                         ProjectedPoint p2, Color c1, Color c2, int maxWidth) {
+    int x0, y0, x1, y1, dx, dy, sx, sy, err, steps, width;
+    int r, g, b, dr, dg, db;
+    int runX, runY, runKey;
+    
+    if (!clipLine(&p1, &p2, &c1, &c2, fb->width, fb->height)) return TRUE;
+    
+    x0 = (int)p1.x;
+    y0 = (int)p1.y;
+    x1 = (int)p2.x;
+    y1 = (int)p2.y;
+    dx = abs(x1 - x0);
+    dy = abs(y1 - y0);
+    sx = x0 < x1 ? 1 : -1;
+    sy = y0 < y1 ? 1 : -1;
+    err = dx - dy;
+    steps = dx > dy ? dx : dy;
+    if (steps == 0) steps = 1;
+    width = (int)edgeLineWidth(p1, p2, maxWidth);
+    
+    /* 16.16 colour, stepped once per pixel */
+    r = (c1.r << 16) + 0x8000;
+    g = (c1.g << 16) + 0x8000;
+    b = (c1.b << 16) + 0x8000;
+    dr = (c2.r - c1.r) * 65536 / steps;
+    dg = (c2.g - c1.g) * 65536 / steps;
+    db = (c2.b - c1.b) * 65536 / steps;
+    
+    runX = x0;
+    runY = y0;
+    runKey = quantizeColor(r >> 16, g >> 16, b >> 16);
+    
+    while (x0 != x1 || y0 != y1) {
+        int e2 = 2 * err;
+        int key;
+        
+        if (e2 > -dy) { err -= dy; x0 += sx; }
+        if (e2 < dx) { err += dx; y0 += sy; }
+        r += dr;
+        g += dg;
+        b += db;
+        
+        /* The pen changes at this pixel: the current run ends just before it */
+        key = quantizeColor(r >> 16, g >> 16, b >> 16);
+        if (key != runKey && (x0 != x1 || y0 != y1)) {
+            if (!addGdiRun(lines, runX, runY, x0, y0, runKey, width)) return FALSE;
+            runX = x0;
+            runY = y0;
+            runKey = key;
+        }
+    }
+    
+    if (runX == x1 && runY == y1) return TRUE;
+    return addGdiRun(lines, runX, runY, x1, y1, runKey, width);
+}
+
+static int compareGdiRun(const void* a, const void* b) {
+    const GdiRun* ra = (const GdiRun*)a;
+    const GdiRun* rb = (const GdiRun*)b;
+    if (ra->width != rb->width) return ra->width - rb->width;
+    return ra->key - rb->key;
+}
+
+/* Draw and clear the queued runs: one SelectObject and one PolyPolyline per pen */
+static void flushGdiLines(HDC hdc, GdiLineBatch* lines) {
+    HPEN oldPen = NULL;
+    int n = lines->runCount;
+    int i, start;
+    
+    lines->runCount = 0;
+    if (n == 0) return;
+    if (!growArray((void**)&lines->points, &lines->pointCapacity, n * 2, sizeof(POINT)) ||
+        !growArray((void**)&lines->counts, &lines->countCapacity, n, sizeof(DWORD))) {
+        return;
+    }
+    
+    qsort(lines->runs, n, sizeof(GdiRun), compareGdiRun);
+    for (i = 0; i < n; i++) {
+        lines->points[i * 2 + 0] = lines->runs[i].from;
+        lines->points[i * 2 + 1] = lines->runs[i].to;
+        lines->counts[i] = 2;
+    }
+    
+    for (start = 0; start < n; start = i) {
+        const GdiRun* run = &lines->runs[start];
+        HPEN pen;
+        
+        for (i = start + 1; i < n && lines->runs[i].key == run->key &&
+                            lines->runs[i].width == run->width; i++) {
+        }
+        pen = (HPEN)SelectObject(hdc, getCachedPen(run->key, run->width));
+        if (!oldPen) oldPen = pen;
+        PolyPolyline(hdc, lines->points + start * 2, lines->counts + start, (DWORD)(i - start));
+    }
+    SelectObject(hdc, oldPen);
+}
+
+/*
+ * Immediate-mode path used by the GDI backend. The toaster's unified
+ * edge list is cut into runs first and submitted in one flush, so a pen
+ * is selected once per colour rather than once per pixel.
+ */
+static void renderToaster(Framebuffer* fb, GdiLineBatch* lines, const VertexBatch* batch, int t,
+                          const QualityLevel* quality) {
+    const MeshLod* mesh = &g_meshLods[batch->lod[t]];
+    int base = t * MESH_BATCH_STRIDE;
+    int edgeCount = quality->bracing ? mesh->edgeCount : mesh->coreEdgeCount;
+    int i;
+    
+    for (i = 0; i < edgeCount; i++) {
+        int v1 = base + mesh->edges[i].v1;
+        int v2 = base + mesh->edges[i].v2;
+        
+        if (batch->valid[v1] && batch->valid[v2] &&
+            !queueGdiLine(lines, fb, batchPoint(batch, v1), batchPoint(batch, v2),
+                          batch->colors[v1], batch->colors[v2], quality->maxLineWidth)) {
+            break;
+        }
+    }
+    flushGdiLines(fb->dc, lines);
+    
+    /* Glow composites straight into the DIB, so queued PolyPolyline work must land first */
+    if (g_showGlow && quality->glow) {
+        int part;
+        GdiFlush();
+        for (part = 0; part < MESH_PART_COUNT; part++) {
+            int k = base + part * MESH_PART_STRIDE;
+            for (i = 0; i < glowVertexCount(&mesh->soa, part); i++, k++) {
+                if (batch->valid[k]) {
+                    compositeGlow(fb, batchPoint(batch, k), batch->colors[k], 0, fb->height);
+                }
+            }
+        }
+    }
+}
+
+/* dt: seconds since the previous frame; a NULL hdc renders without presenting */
+static void renderFrame(Scene* scene, HDC hdc, float dt) {
+    Framebuffer* fb = &scene->fb;
+    FrameProfiler* prof = &scene->profiler;
+    ToasterFlock* flock = &scene->flock;
+    const QualityLevel* quality = &k_qualityLevels[scene->quality.level];
+    BOOL showGlow = g_showGlow && quality->glow;
+    TileJob job;
+    RECT rect;
+    BOOL glowBinned = FALSE;
+    BOOL incremental = !g_showTrails && g_rasterBackend != RASTER_GPU;
+    BOOL repaint = InterlockedExchange(&scene->repaint, 0) != 0;
+    BOOL partial;
+    DirtyRegion drawn, changed;
+    float pixelScale;
+    int i, visible, surfaceWidth, surfaceHeight;
+    
+    EnterCriticalSection(&scene->presentLock);
+    
+    /* May swap in a new back buffer, so before anything reads fb */
+    applySceneResolution(scene);
+    prof->power = (PowerState)g_powerState;
+    pixelScale = (float)scene->scaleNum / (float)scene->scaleDen;
+    surfaceWidth = g_rasterBackend == RASTER_GPU ? scene->gpu.width : fb->width;
+    surfaceHeight = g_rasterBackend == RASTER_GPU ? scene->gpu.height : fb->height;
+    
+    rect.left = 0;
+    rect.top = 0;
+    rect.right = fb->width;
+    rect.bottom = fb->height;
+    
+    job.fb = fb;
+    job.batch = &scene->batch;
+    job.bins = &scene->bins;
+    job.clearColor = 0x000008;
+    job.decay = g_showTrails ? trailDecay(dt) : 0;
+    job.scanlineSpacing = g_scanlineSpacing;
+    job.scanlineKeep = 256 - (g_scanlineIntensity * 256 + 50) / 100;
+    job.maxLineWidth = quality->maxLineWidth;
+    
+    profileBegin(prof, PHASE_FRAME);
+    
+    /* Make sure last frame's GDI work has landed before touching pixels */
+    GdiFlush();
+    
+    /* Update each toaster */
+    profileBegin(prof, PHASE_UPDATE);
+    updateToasters(flock, dt * SIM_TICK_RATE);
+    profileEnd(prof, PHASE_UPDATE);
+    
+    /* Cull off-screen toasters; the surviving keys come out in flock order */
+    profileBegin(prof, PHASE_SORT);
+    visible = cullFlock(flock, scene->cullOrder, scene->onScreen, pixelScale,
+                        surfaceWidth, surfaceHeight);
+    profileEnd(prof, PHASE_SORT);
+    
+    /* Transform, project and shade the visible flock while it's still in memory order */
+    profileBegin(prof, PHASE_TRANSFORM);
+    if (g_rasterBackend == RASTER_GPU) {
+        /* Vertices are transformed and shaded on the GPU; only matrices go up */
+        buildToasterMatrices(flock, &scene->batch, scene->cullOrder, visible);
+    } else {
+        transformFlock(flock, &scene->batch, scene->cullOrder, visible, pixelScale);
+        shadeFlock(flock, &scene->batch, scene->cullOrder, visible);
+    }
+    profileEnd(prof, PHASE_TRANSFORM);
+    
+    /* Then list them far to near; respawns keep the depth index ordered */
+    profileBegin(prof, PHASE_SORT);
+    depthOrderFlock(flock, scene->onScreen, scene->depthOrder);
+    profileEnd(prof, PHASE_SORT);
+    
+    if (g_rasterBackend == RASTER_GPU) {
+        profileBegin(prof, PHASE_TRANSFORM);
+        gpuUploadFlock(&scene->gpu, flock, &scene->batch, scene->depthOrder, visible);
+        profileEnd(prof, PHASE_TRANSFORM);
+    }
+    
+    /*
+     * Incremental frames clear last frame's drawing and this frame's
+     * footprint: everything the scanline pass darkens has then been
+     * cleared exactly once, so partial intensities never compound.
+     */
+    if (incremental) {
+        buildDirtyRegion(&drawn, &scene->batch, scene->depthOrder, visible, fb->width, fb->height);
+        unionDirtyRegion(&changed, &scene->dirty, &drawn, fb->width, fb->height);
+    }
+    job.dirty = (incremental && !changed.full) ? &changed : NULL;
+    
+    /* Clear with trail effect or solid */
+    profileBegin(prof, PHASE_CLEAR);
+    if (g_rasterBackend == RASTER_GPU) {
+        gpuBeginFrame(&scene->gpu, job.decay);
+    } else if (g_rasterBackend == RASTER_DIB) {
+        job.pass = TILE_PASS_CLEAR;
+        runTileJob(&scene->pool, &job);
+    } else if (job.decay) {
+        /* Fade last frame in place; GdiFlush above landed GDI's writes */
+        decayFramebufferRows(fb, 0, fb->height, job.clearColor, job.decay);
+    } else if (job.dirty) {
+        for (i = 0; i < job.dirty->count; i++) {
+            FillRect(fb->dc, &job.dirty->rects[i], g_gdi.clearBrush);
+        }
+    } else {
+        FillRect(fb->dc, &rect, g_gdi.clearBrush);
+    }
+    profileEnd(prof, PHASE_CLEAR);
+    
+    /* Render back to front (the GDI path interleaves its glow here) */
+    profileBegin(prof, PHASE_RASTER);
+    if (g_rasterBackend == RASTER_GPU) {
+        gpuDrawEdges(&scene->gpu, visible, quality->bracing);
+    } else if (g_rasterBackend == RASTER_DIB) {
+        if (!binFlockEdges(&scene->bins, &scene->batch, scene->depthOrder, visible,
+                           quality->bracing)) {
+            scene->bins.edgeCount = 0;
+            for (i = 0; i <= scene->bins.bandCount; i++) scene->bins.bandStart[i] = 0;
+        }
+        
+        job.pass = TILE_PASS_RASTER;
+        runTileJob(&scene->pool, &job);
+    } else {
+        for (i = 0; i < visible; i++) {
+            renderToaster(fb, &scene->lines, &scene->batch, scene->depthOrder[i].index, quality);
+        }
+    }
+    profileEnd(prof, PHASE_RASTER);
+    
+    /* Additive glow sprites on top of the rasterized bands */
+    if (g_rasterBackend == RASTER_DIB && showGlow) {
+        profileBegin(prof, PHASE_GLOW);
+        glowBinned = binFlockGlow(&scene->glowBins, &scene->batch, scene->depthOrder, visible);
+        if (glowBinned) {
+            job.pass = TILE_PASS_GLOW;
+            job.bins = &scene->glowBins;
+            runTileJob(&scene->pool, &job);
+            job.bins = &scene->bins;
+        }
+        profileEnd(prof, PHASE_GLOW);
+    } else if (g_rasterBackend == RASTER_GPU && showGlow) {
+        profileBegin(prof, PHASE_GLOW);
+        gpuDrawGlow(&scene->gpu, visible);
+        profileEnd(prof, PHASE_GLOW);
+    }
+    
+    if (g_rasterBackend == RASTER_DIB) {
+        ageBands(&scene->bins, glowBinned ? &scene->glowBins : NULL, dt * SIM_TICK_RATE);
+    }
+    
+    /* Scanline effect */
+    profileBegin(prof, PHASE_SCANLINES);
+    if (g_showScanlines && g_rasterBackend == RASTER_GPU) {
+        gpuDrawScanlines(&scene->gpu);
+    } else if (g_showScanlines) {
+        /* Banded darkening pass; the GDI backend has no workers, so it runs here */
+        if (g_rasterBackend == RASTER_GDI) GdiFlush();
+        job.pass = TILE_PASS_SCANLINES;
+        runTileJob(&scene->pool, &job);
+    }
+    profileEnd(prof, PHASE_SCANLINES);
+    
+    if (g_showStats && g_rasterBackend == RASTER_GPU) {
+        gpuDrawHud(&scene->gpu, prof, g_adaptiveQuality ? scene->quality.level : -1);
+    } else if (g_showStats) {
+        drawProfilerHud(fb->dc, prof, g_adaptiveQuality ? scene->quality.level : -1);
+    }
+    
+    /* Blit to screen */
+    profileBegin(prof, PHASE_PRESENT);
+    partial = incremental && !changed.full && !repaint;
+    prof->presentLatency = -1.0f;
+    if (!hdc) {
+        /* Nothing reached the screen, so the next present has to be a full one */
+        GdiFlush();
+        InterlockedExchange(&scene->repaint, 1);
+    } else if (g_rasterBackend == RASTER_GPU) {
+        prof->present = scene->gpu.flip ? PRESENT_FLIP : PRESENT_BLIT;
+        prof->presentKB = presentedKB(scene, NULL);
+        prof->presentLatency = gpuPresent(&scene->gpu, prof->frequency);
+    } else if (scene->gpu.swapChain) {
+        /* The canvas keeps earlier uploads, so a partial frame sends only its rects */
+        GdiFlush();
+        prof->present = PRESENT_FLIP;
+        prof->presentKB = presentedKB(scene, partial ? &changed : NULL);
+        gpuUploadFramebuffer(&scene->gpu, fb, partial ? &changed : NULL);
+        prof->presentLatency = gpuPresent(&scene->gpu, prof->frequency);
+    } else {
+        prof->present = partial ? PRESENT_DIRTY : PRESENT_BLIT;
+        prof->presentKB = presentedKB(scene, partial ? &changed : NULL);
+        if (g_remoteSession) {
+            GdiFlush();
+            quantizeForRemote(fb, partial ? &changed : NULL);
+        }
+        
+        if (scene->scaleNum != scene->scaleDen) {
+            presentScaled(scene, hdc, partial ? &changed : NULL);
+        } else if (partial) {
+            for (i = 0; i < changed.count; i++) {
+                const RECT* r = &changed.rects[i];
+                BitBlt(hdc, scene->origin.x + r->left, scene->origin.y + r->top,
+                       r->right - r->left, r->bottom - r->top, fb->dc, r->left, r->top, SRCCOPY);
+            }
+        } else {
+            BitBlt(hdc, scene->origin.x, scene->origin.y, fb->width, fb->height, fb->dc, 0, 0, SRCCOPY);
+        }
+        
+        /* So the present time covers the blits, not just their queueing */
+        GdiFlush();
+    }
+    profileEnd(prof, PHASE_PRESENT);
+    
+    /* Until the window is shown, presents land nowhere; offscreen scenes always count */
+    if (hdc && (!scene->hWnd || IsWindowVisible(scene->hWnd))) profilePresented(prof);
+    
+    /* Next frame clears what this one drew */
+    if (incremental) {
+        scene->dirty = drawn;
+    } else {
+        markDirtyFull(&scene->dirty);
+    }
+    
+    profileEnd(prof, PHASE_FRAME);
+    profileEndFrame(prof);
+    
+    /* Between frames, so a new back buffer never swaps in mid-render */
+    if (g_adaptiveQuality) governQuality(scene);
+    
+    LeaveCriticalSection(&scene->presentLock);
+}
+
+/* ============================================
+   RENDERER LIFETIME
+   ============================================ */
+
+/* Monitors overlapping the saver window, in its client coordinates */
+typedef struct {
+    HWND hWnd;
+    RECT client;
+    RECT bounds[MAX_MONITORS];
+    int refreshHz[MAX_MONITORS];
+    int count;
+} MonitorList;
+
+static BOOL CALLBACK addMonitor(HMONITOR monitor, HDC dc, LPRECT monitorRect, LPARAM param) {
+    MonitorList* list = (MonitorList*)param;
+    MONITORINFOEXA info;
+    DEVMODEA mode;
+    RECT r = *monitorRect;
+    int i = list->count;
+    
+    if (i == MAX_MONITORS) return FALSE;
+    
+    /* Monitor rects are virtual-desktop coordinates; scenes live in the client area */
+    MapWindowPoints(NULL, list->hWnd, (POINT*)&r, 2);
+    if (!IntersectRect(&list->bounds[i], &r, &list->client)) return TRUE;
+    
+    list->refreshHz[i] = 0;
+    info.cbSize = sizeof(info);
+    ZeroMemory(&mode, sizeof(mode));
+    mode.dmSize = sizeof(mode);
+    if (GetMonitorInfoA(monitor, (MONITORINFO*)&info) &&
+        EnumDisplaySettingsA(info.szDevice, ENUM_CURRENT_SETTINGS, &mode) &&
+        mode.dmDisplayFrequency > 1) {
+        list->refreshHz[i] = (int)mode.dmDisplayFrequency;
+    }
+    list->count++;
+    return TRUE;
+}
+
+/*
+ * Everything one scene's renderFrame needs, sized for the `bounds` part
+ * of the saver window. The shared models and caches must already exist;
+ * on failure destroyScene releases whatever was created. The flock draws
+ * from stream `stream` of `seed`, so a fixed seed replays every scene.
+ */
+static BOOL createScene(Scene* scene, HWND hWnd, HDC screenDC, const RECT* bounds,
+                        int refreshHz, int threads, BOOL csv, unsigned int seed, int stream) {
+    ZeroMemory(scene, sizeof(*scene));
+    InitializeCriticalSection(&scene->presentLock);
+    scene->hWnd = hWnd;
+    scene->origin.x = bounds->left;
+    scene->origin.y = bounds->top;
+    scene->width = bounds->right - bounds->left;
+    scene->height = bounds->bottom - bounds->top;
+    scene->refreshHz = refreshHz;
+    initQualityGovernor(&scene->quality);
+    if (g_preview) scene->quality.level = PREVIEW_QUALITY;
+    sceneTargetScale(scene, &scene->scaleNum, &scene->scaleDen);
+    
+    /* Nothing on screen is ours yet */
+    markDirtyFull(&scene->dirty);
+    
+    /* Initialize toasters */
+    if (!allocFlock(&scene->flock, g_toasterCount)) return FALSE;
+    scene->flock.width = (float)scene->width;
+    scene->flock.height = (float)scene->height;
+    scene->cullOrder = (DepthKey*)malloc(sizeof(DepthKey) * scene->flock.capacity);
+    scene->depthOrder = (DepthKey*)malloc(sizeof(DepthKey) * scene->flock.capacity);
+    scene->onScreen = (BYTE*)malloc(scene->flock.capacity);
+    if (!scene->cullOrder || !scene->depthOrder || !scene->onScreen ||
+        !allocVertexBatch(&scene->batch, scene->flock.capacity)) {
+        return FALSE;
+    }
+    seedRng(&scene->flock.rng, seed, (unsigned int)stream);
+    initFlock(&scene->flock);
+    
+    if (g_rasterBackend == RASTER_GPU &&
+        !createGpuRenderer(&scene->gpu, hWnd,
+                           (scene->width * scene->scaleNum + scene->scaleDen - 1) / scene->scaleDen,
+                           (scene->height * scene->scaleNum + scene->scaleDen - 1) / scene->scaleDen,
+                           (float)scene->scaleNum / (float)scene->scaleDen, scene->flock.capacity)) {
+        destroyGpuRenderer(&scene->gpu);
+        g_rasterBackend = DEFAULT_RASTER;
+    }
+    
+    /* Create double buffer (32-bit DIB section) at the render scale */
+    if (g_rasterBackend != RASTER_GPU &&
+        !createFramebuffer(&scene->fb, screenDC,
+                           scaledExtent(scene->width, scene->scaleNum, scene->scaleDen),
+                           scaledExtent(scene->height, scene->scaleNum, scene->scaleDen))) {
+        return FALSE;
+    }
+    
+    /* Band workers for the DIB rasterizer */
+    if (!setupBands(&scene->bins, scene->fb.height, threads) ||
+        !setupBands(&scene->glowBins, scene->fb.height, threads)) {
+        return FALSE;
+    }
+    scene->bins.pad = MAX_LINE_WIDTH;
+    scene->glowBins.pad = GLOW_MAX_RADIUS + 1;
+    if (g_rasterBackend == RASTER_DIB) createRenderPool(&scene->pool, threads);
+    
+    initProfiler(&scene->profiler, csv ? g_profileCsvPath : NULL);
     return TRUE;
 }
 
-static void drawGradientLine(HDC hdc, ProjectedPoint p1, ProjectedPoint p2, 
-                             Color c1, Color c2) {
-    /* Bresenham with color interpolation */
-    int x0 = (int)p1.x, y0 = (int)p1.y;
-    int x1 = (int)p2.x, y1 = (int)p2.y;
+static void destroyScene(Scene* scene) {
+    closeProfiler(&scene->profiler);
+    destroyGpuRenderer(&scene->gpu);
+    destroyRenderPool(&scene->pool);
+    freeEdgeBins(&scene->bins);
+    freeEdgeBins(&scene->glowBins);
+    freeGdiLines(&scene->lines);
+    destroyFramebuffer(&scene->fb);
+    freeFlock(&scene->flock);
+    freeVertexBatch(&scene->batch);
+    free(scene->cullOrder);
+    free(scene->depthOrder);
+    free(scene->onScreen);
+    scene->cullOrder = NULL;
+    scene->depthOrder = NULL;
+    scene->onScreen = NULL;
+    DeleteCriticalSection(&scene->presentLock);
+}
+
+/*
+ * Builds the scenes for a width x height saver window and the resources
+ * they share. Reads the current settings globals; on failure the caller
+ * still runs destroyRenderer. Per-monitor mode (which needs hWnd) splits
+ * the window along monitor edges, so toasters never fly across a bezel
+ * and no back buffer is larger than one monitor. The GPU backend needs a
+ * window to own its swap chain; without one, without a usable adapter,
+ * or with more than one scene it falls back to the software rasterizer.
+ * A single software scene on a composited session presents through a
+ * flip swap chain of its own when D3D11 loads, and by BitBlt otherwise.
+ */
+static BOOL createRenderer(HWND hWnd, HDC screenDC, int width, int height) {
+    MonitorList monitors;
+    unsigned int seed = g_seed ? g_seed : mixSeed((unsigned int)time(NULL)) ^ GetTickCount();
+    int i, threads;
     
-    int dx = abs(x1 - x0);
-    int dy = abs(y1 - y0);
-    int sx = x0 < x1 ? 1 : -1;
-    int sy = y0 < y1 ? 1 : -1;
-    int err = dx - dy;
+    createToasterModels();
+    buildWingKeyframes();
+    buildLightingTables();
+    createGdiCache();
+    if (!buildGlowAtlas(&g_glowAtlas)) return FALSE;
     
-    int steps = dx > dy ? dx : dy;
-    if (steps == 0) steps = 1;
+    monitors.count = 0;
+    if (g_perMonitor && hWnd) {
+        monitors.hWnd = hWnd;
+        SetRect(&monitors.client, 0, 0, width, height);
+        EnumDisplayMonitors(NULL, NULL, addMonitor, (LPARAM)&monitors);
+    }
+    if (monitors.count < 2) {
+        monitors.count = 1;
+        SetRect(&monitors.bounds[0], 0, 0, width, height);
+        monitors.refreshHz[0] = 0;
+    }
     
-    float lineWidth = (p1.scale + p2.scale) * 0.4f;
-    if (lineWidth < 1.0f) lineWidth = 1.0f;
-    if (lineWidth > 4.0f) lineWidth = 4.0f;
+    /* One swap chain per window, and the window spans every scene */
+    if (monitors.count > 1 && g_rasterBackend == RASTER_GPU) {
+        g_rasterBackend = DEFAULT_RASTER;
+    }
     
-    HPEN pen = NULL;
-    HPEN oldPen = NULL;
-    int lastR = -1, lastG = -1, lastB = -1;
+    /* The GDI line path doesn't scale to swarm counts; glow stays the user's call */
+    if (g_toasterCount > MAX_TOASTERS && g_rasterBackend != RASTER_GPU) {
+        g_rasterBackend = RASTER_DIB;
+    }
     
-    int step = 0;
-    while (1) {
-        float t = (float)step / (float)steps;
-        
-        int r = (int)(c1.r + (c2.r - c1.r) * t);
-        int g = (int)(c1.g + (c2.g - c1.g) * t);
-        int b = (int)(c1.b + (c2.b - c1.b) * t);
-        
-        /* Only create new pen if color changed significantly */
-        if (abs(r - lastR) > 8 || abs(g - lastG) > 8 || abs(b - lastB) > 8 || pen == NULL) {
-            if (pen) {
-                SelectObject(hdc, oldPen);
-                DeleteObject(pen);
-            }
-            pen = CreatePen(PS_SOLID, (int)lineWidth, RGB(r, g, b));
-            oldPen = (HPEN)SelectObject(hdc, pen);
-            lastR = r; lastG = g; lastB = b;
+    /* Split the cores between the scenes' band workers */
+    threads = g_renderThreads ? g_renderThreads : countPhysicalCores();
+    threads = threads / monitors.count > 0 ? threads / monitors.count : 1;
+    
+    for (i = 0; i < monitors.count; i++) {
+        g_sceneCount = i + 1;
+        if (!createScene(&g_scenes[i], hWnd, screenDC, &monitors.bounds[i],
+                         monitors.refreshHz[i], threads, i == 0, seed, i)) {
+            return FALSE;
         }
-        
-        /* Draw a small segment */
-        MoveToEx(hdc, x0, y0, NULL);
-        
-        if (x0 == x1 && y0 == y1) break;
-        
-        int e2 = 2 * err;
-        int nextX = x0, nextY = y0;
-        
-        if (e2 > -dy) { err -= dy; nextX += sx; }
-        if (e2 < dx) { err += dx; nextY += sy; }
-        
-        LineTo(hdc, nextX, nextY);
-        
-        x0 = nextX;
-        y0 = nextY;
-        step++;
     }
     
-    if (pen) {
-        SelectObject(hdc, oldPen);
-        DeleteObject(pen);
+    /* Software frames go to DWM by flip where it can take them; BitBlt otherwise */
+    if (monitors.count == 1 && g_rasterBackend != RASTER_GPU) {
+        Scene* scene = &g_scenes[0];
+        if (!createGpuSwapChain(&scene->gpu, hWnd,
+                                (width * scene->scaleNum + scene->scaleDen - 1) / scene->scaleDen,
+                                (height * scene->scaleNum + scene->scaleDen - 1) / scene->scaleDen,
+                                (float)scene->scaleNum / (float)scene->scaleDen, TRUE)) {
+            destroyGpuRenderer(&scene->gpu);
+        }
+    }
+    return TRUE;
+}
+
+static void destroyRenderer(void) {
+    int i;
+    
+    for (i = 0; i < g_sceneCount; i++) {
+        destroyScene(&g_scenes[i]);
     }
+    g_sceneCount = 0;
+    freeGlowAtlas(&g_glowAtlas);
+    destroyGdiCache();
 }
 
-static void drawVertexGlow(HDC hdc, ProjectedPoint p, Color c) {
-    if (!g_showGlow) return;
+#ifndef FT_BENCHMARK
+
+/* ============================================
+   POWER MANAGEMENT
+   ============================================ */
+
+/* winnt.h declares these, but nothing links their definitions in */
+static const GUID k_powerSourceGuid =   /* GUID_ACDC_POWER_SOURCE */
+    { 0x5d3e9a59, 0xe9d5, 0x4b00, { 0xa6, 0xbd, 0xff, 0x34, 0xff, 0x51, 0x65, 0x48 } };
+static const GUID k_energySaverGuid =   /* GUID_POWER_SAVING_STATUS */
+    { 0xe00958c0, 0xc213, 0x4ace, { 0xac, 0x77, 0xfe, 0xcc, 0xed, 0x2e, 0xee, 0xa5 } };
+static const GUID k_displayStateGuid =  /* GUID_CONSOLE_DISPLAY_STATE */
+    { 0x6fe69556, 0x704a, 0x47a0, { 0x8f, 0x24, 0xc2, 0x8d, 0x93, 0x6f, 0xda, 0x47 } };
+
+static void publishPowerState(void) {
+    LONG state = POWER_NORMAL;
     
-    int glowSize = (int)(3.0f * p.scale);
-    if (glowSize < 2) glowSize = 2;
-    if (glowSize > 20) glowSize = 20;
+    if (!g_powerAware) state = POWER_NORMAL;
+    else if (g_power.displayOff) state = POWER_DISPLAY_OFF;
+    else if (g_power.onBattery || g_power.energySaver) state = POWER_SAVER;
     
-    /* Simple radial glow approximation */
-    int i;
-    for (i = glowSize; i > 0; i -= 2) {
-        float t = (float)i / (float)glowSize;
-        int alpha = (int)(255 * (1.0f - t) * 0.3f);
-        
-        int r = c.r + (255 - c.r) * (1.0f - t);
-        int g = c.g + (255 - c.g) * (1.0f - t);
-        int b = c.b + (255 - c.b) * (1.0f - t);
-        
-        HBRUSH brush = CreateSolidBrush(RGB(r * alpha / 255, 
-                                            g * alpha / 255, 
-                                            b * alpha / 255));
-        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, brush);
-        HPEN pen = CreatePen(PS_NULL, 0, 0);
-        HPEN oldPen = (HPEN)SelectObject(hdc, pen);
-        
-        Ellipse(hdc, (int)p.x - i, (int)p.y - i, 
-                     (int)p.x + i, (int)p.y + i);
-        
-        SelectObject(hdc, oldPen);
-        SelectObject(hdc, oldBrush);
-        DeleteObject(pen);
-        DeleteObject(brush);
+    InterlockedExchange(&g_powerState, state);
+    if (state == POWER_DISPLAY_OFF) {
+        ResetEvent(g_displayOnEvent);
+    } else {
+        SetEvent(g_displayOnEvent);
+    }
+}
+
+/* WM_TIMER fallback: follow the power state with the timer period */
+static void updateFallbackTimer(HWND hWnd) {
+    UINT interval = g_powerState == POWER_SAVER ? 1000 / POWER_SAVER_FPS : FRAME_INTERVAL;
+    
+    if (g_timerInterval && interval != g_timerInterval) {
+        SetTimer(hWnd, TIMER_ID, interval, NULL);
+        g_timerInterval = interval;
     }
 }
 
-static void renderToaster(HDC hdc, FlyingToaster* toaster) {
-    float centerX = toaster->x;
-    float centerY = toaster->y;
-    float wingAngle = getWingAngle(toaster);
+/*
+ * Seeds the state from GetSystemPowerStatus, then subscribes; each
+ * registration also delivers the setting's current value right away.
+ */
+static void startPowerMonitor(HWND hWnd) {
+    SYSTEM_POWER_STATUS status;
     
-    Vec3 transformedVerts[MAX_VERTICES];
-    ProjectedPoint projectedVerts[MAX_VERTICES];
-    Color vertexColors[MAX_VERTICES];
-    BOOL validVerts[MAX_VERTICES];
+    ZeroMemory(&g_power, sizeof(g_power));
+    g_displayOnEvent = CreateEventW(NULL, TRUE, TRUE, NULL);
+    if (!g_powerAware || !g_displayOnEvent) return;
     
+    if (GetSystemPowerStatus(&status)) {
+        g_power.onBattery = status.ACLineStatus == 0;
+    }
+    publishPowerState();
+    
+    /* Power broadcasts go to top-level windows; the /p preview is a child */
+    if (fChildPreview) return;
+    
+    g_power.notify[0] = RegisterPowerSettingNotification(hWnd, &k_powerSourceGuid,
+                                                         DEVICE_NOTIFY_WINDOW_HANDLE);
+    g_power.notify[1] = RegisterPowerSettingNotification(hWnd, &k_energySaverGuid,
+                                                         DEVICE_NOTIFY_WINDOW_HANDLE);
+    g_power.notify[2] = RegisterPowerSettingNotification(hWnd, &k_displayStateGuid,
+                                                         DEVICE_NOTIFY_WINDOW_HANDLE);
+}
+
+static void stopPowerMonitor(void) {
     int i;
     
-    /* Transform and project body vertices */
-    for (i = 0; i < toaster->body.vertexCount; i++) {
-        Vec3 v = toaster->body.vertices[i];
-        v = vec3_scale(v, toaster->scale);
-        v = rotateX(v, toaster->rotX);
-        v = rotateY(v, toaster->rotY);
-        v.z += toaster->z;
-        transformedVerts[i] = v;
-        
-        Vec3 normal = vec3_normalize((Vec3){ v.x * 0.3f, v.y, v.z * 0.5f });
-        vertexColors[i] = computeVertexColor(v, normal);
-        validVerts[i] = project(v, centerX, centerY, &projectedVerts[i]);
+    for (i = 0; i < 3; i++) {
+        if (g_power.notify[i]) UnregisterPowerSettingNotification(g_power.notify[i]);
     }
+    ZeroMemory(&g_power, sizeof(g_power));
+    g_powerState = POWER_NORMAL;
+    if (g_displayOnEvent) CloseHandle(g_displayOnEvent);
+    g_displayOnEvent = NULL;
+}
+
+/* PBT_POWERSETTINGCHANGE; the render threads pick the new state up next frame */
+static void onPowerSettingChange(HWND hWnd, const POWERBROADCAST_SETTING* setting) {
+    DWORD value;
     
-    /* Draw body edges */
-    for (i = 0; i < toaster->body.edgeCount; i++) {
-        int v1 = toaster->body.edges[i].v1;
-        int v2 = toaster->body.edges[i].v2;
-        
-        if (validVerts[v1] && validVerts[v2]) {
-            drawGradientLine(hdc, projectedVerts[v1], projectedVerts[v2],
-                           vertexColors[v1], vertexColors[v2]);
-        }
+    if (!g_displayOnEvent || setting->DataLength < sizeof(DWORD)) return;
+    value = *(const DWORD*)setting->Data;
+    
+    if (IsEqualGUID(&setting->PowerSetting, &k_powerSourceGuid)) {
+        g_power.onBattery = value != 0;     /* PoDc, or PoHot (UPS) */
+    } else if (IsEqualGUID(&setting->PowerSetting, &k_energySaverGuid)) {
+        g_power.energySaver = value != 0;
+    } else if (IsEqualGUID(&setting->PowerSetting, &k_displayStateGuid)) {
+        g_power.displayOff = value == 0;    /* 1 = on, 2 = dimmed */
+    } else {
+        return;
     }
+    publishPowerState();
+    updateFallbackTimer(hWnd);
+}
+
+/* ============================================
+   FRAME PACING
+   ============================================ */
+
+/*
+ * Sleep on the waitable timer for most of the gap, then yield-spin the
+ * tail. High-resolution timers (Windows 10 1803+) wake within ~0.5 ms;
+ * the legacy timer needs a wider margin for the ~1-15 ms tick.
+ */
+static void waitUntil(FrameLoop* loop, LONGLONG deadline) {
+    LONGLONG slack = loop->frequency / (loop->highResTimer ? 2000 : 250);
+    LONGLONG remaining = deadline - qpcNow();
     
-    /* Draw vertex glow on corners */
-    for (i = 0; i < 4 && i < toaster->body.vertexCount; i++) {
-        if (validVerts[i]) {
-            drawVertexGlow(hdc, projectedVerts[i], vertexColors[i]);
+    if (loop->timer && remaining > slack) {
+        LARGE_INTEGER due;
+        /* Relative due time in 100 ns units */
+        due.QuadPart = -((remaining - slack) * 10000000 / loop->frequency);
+        if (SetWaitableTimer(loop->timer, &due, 0, NULL, NULL, FALSE)) {
+            WaitForSingleObject(loop->timer, INFINITE);
         }
     }
     
-    /* Render wings */
-    Model* wings[2] = { &toaster->leftWing, &toaster->rightWing };
-    int isLeft[2] = { 1, 0 };
+    while (qpcNow() < deadline && !loop->quit) {
+        Sleep(0);
+    }
+}
+
+/* Monitor refresh rate, for pacing vsync when DwmFlush is unavailable */
+static int displayRefreshRate(HWND hWnd) {
+    HDC hdc = GetDC(hWnd);
+    int hz = hdc ? GetDeviceCaps(hdc, VREFRESH) : 0;
+    if (hdc) ReleaseDC(hWnd, hdc);
+    /* 0 and 1 both mean "hardware default" */
+    return hz > 1 ? hz : DEFAULT_TARGET_FPS;
+}
+
+/*
+ * With several scenes, DwmFlush only tracks one compositor clock, so
+ * vsync paces each scene to its own monitor's refresh rate instead.
+ * The power state is re-read every frame: saver mode caps the rate at
+ * POWER_SAVER_FPS, and with the display off the thread just waits.
+ */
+static DWORD WINAPI frameLoopProc(LPVOID param) {
+    FrameLoop* loop = (FrameLoop*)param;
+    Scene* scene = loop->scene;
+    BOOL dwmVsync = g_vsync && (g_sceneCount == 1 || !scene->refreshHz);
+    int fps = (g_vsync && !dwmVsync) ? scene->refreshHz : g_targetFps;
+    LONGLONG interval = fps ? loop->frequency / fps : 0;
+    LONGLONG saverInterval = loop->frequency / POWER_SAVER_FPS;
+    LONGLONG last = qpcNow() - loop->frequency / DEFAULT_TARGET_FPS;
+    LONGLONG next = qpcNow();
+    
+    if (saverInterval < interval) saverInterval = interval;
     
-    int w;
-    for (w = 0; w < 2; w++) {
-        Model* wing = wings[w];
-        float flapAngle = isLeft[w] ? -wingAngle : wingAngle;
-        float pivotX = isLeft[w] ? -1.0f : 1.0f;
+    /* Vsync without a compositor (DwmFlush fails) paces at the refresh rate */
+    if (!interval && g_vsync) {
+        interval = loop->frequency / displayRefreshRate(loop->hWnd);
+    }
+    
+    while (!loop->quit) {
+        LONGLONG now = qpcNow();
+        float dt = (float)(now - last) / (float)loop->frequency;
+        BOOL saver = g_powerState == POWER_SAVER;
+        HDC hdc;
         
-        /* Transform wing vertices */
-        for (i = 0; i < wing->vertexCount; i++) {
-            Vec3 v = wing->vertices[i];
-            
-            /* Apply wing flap around pivot */
-            v.x -= pivotX;
-            v = rotateZ(v, flapAngle);
-            v.x += pivotX;
-            
-            /* Apply toaster transform */
-            v = vec3_scale(v, toaster->scale);
-            v = rotateX(v, toaster->rotX);
-            v = rotateY(v, toaster->rotY);
-            v.z += toaster->z;
-            transformedVerts[i] = v;
-            
-            /* Wing coloring - lighter/golden */
-            Vec3 normal = vec3_normalize((Vec3){ 0, 1.0f, 0 });
-            Color baseColor = computeVertexColor(v, normal);
-            vertexColors[i].r = (BYTE)min(255, baseColor.r + 100);
-            vertexColors[i].g = (BYTE)min(255, baseColor.g + 50);
-            vertexColors[i].b = baseColor.b;
-            
-            validVerts[i] = project(v, centerX, centerY, &projectedVerts[i]);
+        if (g_powerState == POWER_DISPLAY_OFF) {
+            WaitForSingleObject(g_displayOnEvent, DISPLAY_OFF_POLL_MS);
+            /* Resume where the flock left off rather than catching up */
+            last = qpcNow();
+            next = last;
+            continue;
         }
         
-        /* Draw wing edges */
-        for (i = 0; i < wing->edgeCount; i++) {
-            int v1 = wing->edges[i].v1;
-            int v2 = wing->edges[i].v2;
-            
-            if (validVerts[v1] && validVerts[v2]) {
-                drawGradientLine(hdc, projectedVerts[v1], projectedVerts[v2],
-                               vertexColors[v1], vertexColors[v2]);
-            }
+        last = now;
+        if (dt > MAX_FRAME_DT) dt = MAX_FRAME_DT;
+        
+        hdc = GetDC(loop->hWnd);
+        renderFrame(scene, hdc, dt);
+        ReleaseDC(loop->hWnd, hdc);
+        
+        /* DwmFlush blocks until the next composition pass (vsync) */
+        if (dwmVsync && !saver && SUCCEEDED(DwmFlush())) continue;
+        
+        if (saver || interval) {
+            LONGLONG step = saver ? saverInterval : interval;
+            next += step;
+            /* Fell more than a frame behind: resync instead of bursting */
+            if (qpcNow() - next > step) next = qpcNow();
+            waitUntil(loop, next);
         }
     }
-}
-
-static int compareToasterDepth(const void* a, const void* b) {
-    const FlyingToaster* ta = (const FlyingToaster*)a;
-    const FlyingToaster* tb = (const FlyingToaster*)b;
-    if (ta->z > tb->z) return -1;
-    if (ta->z < tb->z) return 1;
     return 0;
 }
 
-static void renderFrame(HDC hdc) {
-    RECT rect;
-    rect.left = 0;
-    rect.top = 0;
-    rect.right = g_screenWidth;
-    rect.bottom = g_screenHeight;
-    
-    /* Clear with trail effect or solid */
-    if (g_showTrails) {
-        /* Semi-transparent overlay for trails */
-        HBRUSH brush = CreateSolidBrush(RGB(0, 0, 8));
-        FillRect(g_memDC, &rect, brush);
-        DeleteObject(brush);
-    } else {
-        HBRUSH brush = CreateSolidBrush(RGB(0, 0, 8));
-        FillRect(g_memDC, &rect, brush);
-        DeleteObject(brush);
-    }
+static BOOL startFrameLoop(FrameLoop* loop, HWND hWnd, Scene* scene) {
+    LARGE_INTEGER freq;
     
-    /* Sort toasters by depth */
-    FlyingToaster sortedToasters[MAX_TOASTERS];
-    memcpy(sortedToasters, g_toasters, sizeof(FlyingToaster) * g_toasterCount);
-    qsort(sortedToasters, g_toasterCount, sizeof(FlyingToaster), compareToasterDepth);
+    ZeroMemory(loop, sizeof(*loop));
+    loop->hWnd = hWnd;
+    loop->scene = scene;
+    QueryPerformanceFrequency(&freq);
+    loop->frequency = freq.QuadPart;
     
-    /* Update and render each toaster */
-    int i;
-    for (i = 0; i < g_toasterCount; i++) {
-        /* Update original (not sorted copy) */
-        updateToaster(&g_toasters[i]);
+    loop->timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                         TIMER_ALL_ACCESS);
+    loop->highResTimer = loop->timer != NULL;
+    if (!loop->timer) {
+        loop->timer = CreateWaitableTimerW(NULL, TRUE, NULL);
     }
     
-    for (i = 0; i < g_toasterCount; i++) {
-        renderToaster(g_memDC, &sortedToasters[i]);
+    loop->thread = CreateThread(NULL, 0, frameLoopProc, loop, 0, NULL);
+    if (!loop->thread) {
+        if (loop->timer) CloseHandle(loop->timer);
+        loop->timer = NULL;
+        return FALSE;
     }
-    
-    /* Scanline effect */
-    if (g_showScanlines) {
-        int y;
-        HPEN pen = CreatePen(PS_SOLID, 1, RGB(0, 0, 0));
-        HPEN oldPen = (HPEN)SelectObject(g_memDC, pen);
-        
-        for (y = 0; y < g_screenHeight; y += 3) {
-            MoveToEx(g_memDC, 0, y, NULL);
-            LineTo(g_memDC, g_screenWidth, y);
+    SetThreadPriority(loop->thread, THREAD_PRIORITY_ABOVE_NORMAL);
+    return TRUE;
+}
+
+static void stopFrameLoop(FrameLoop* loop) {
+    if (loop->thread) {
+        InterlockedExchange(&loop->quit, 1);
+        WaitForSingleObject(loop->thread, INFINITE);
+        CloseHandle(loop->thread);
+    }
+    if (loop->timer) CloseHandle(loop->timer);
+    ZeroMemory(loop, sizeof(*loop));
+}
+
+static void stopSceneLoops(void) {
+    int i;
+    for (i = 0; i < g_sceneCount; i++) {
+        stopFrameLoop(&g_scenes[i].loop);
+    }
+}
+
+/* One render thread per scene; all or nothing, so WM_TIMER can take over */
+static BOOL startSceneLoops(HWND hWnd) {
+    int i;
+    for (i = 0; i < g_sceneCount; i++) {
+        if (!startFrameLoop(&g_scenes[i].loop, hWnd, &g_scenes[i])) {
+            stopSceneLoops();
+            return FALSE;
         }
-        
-        SelectObject(g_memDC, oldPen);
-        DeleteObject(pen);
     }
-    
-    /* Blit to screen */
-    BitBlt(hdc, 0, 0, g_screenWidth, g_screenHeight, g_memDC, 0, 0, SRCCOPY);
+    return TRUE;
 }
 
 /* ============================================
    SETTINGS PERSISTENCE
    ============================================ */
 
+static int maxToasterCount(void) {
+    return g_swarmMode ? MAX_SWARM_TOASTERS : MAX_TOASTERS;
+}
+
 static void loadSettings(void) {
     HKEY hKey;
     DWORD value, size;
@@ -662,8 +4777,11 @@ static void loadSettings(void) {
         size = sizeof(DWORD);
         if (RegQueryValueExA(hKey, "ToasterCount", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
             g_toasterCount = value;
-            if (g_toasterCount < 1) g_toasterCount = 1;
-            if (g_toasterCount > MAX_TOASTERS) g_toasterCount = MAX_TOASTERS;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "Swarm", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_swarmMode = value ? TRUE : FALSE;
         }
         
         size = sizeof(DWORD);
@@ -671,18 +4789,154 @@ static void loadSettings(void) {
             g_showScanlines = value ? TRUE : FALSE;
         }
         
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "ScanlineSpacing", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_scanlineSpacing = (value < 2) ? 2 : (value > MAX_SCANLINE_SPACING) ? MAX_SCANLINE_SPACING : (int)value;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "ScanlineIntensity", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_scanlineIntensity = (value > 100) ? 100 : (int)value;
+        }
+        
         size = sizeof(DWORD);
         if (RegQueryValueExA(hKey, "Glow", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
             g_showGlow = value ? TRUE : FALSE;
         }
         
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "GlowAllVertices", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_glowAllVertices = value ? TRUE : FALSE;
+        }
+        
         size = sizeof(DWORD);
         if (RegQueryValueExA(hKey, "Trails", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
             g_showTrails = value ? TRUE : FALSE;
         }
         
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "RenderScale", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_renderScale = k_renderScales[findRenderScale(value > 100 ? 100 : (int)value)].percent;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "AdaptiveQuality", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_adaptiveQuality = value ? TRUE : FALSE;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "PowerAware", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_powerAware = value ? TRUE : FALSE;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "RemoteAware", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_remoteAware = value ? TRUE : FALSE;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "PerMonitor", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_perMonitor = value ? TRUE : FALSE;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "Renderer", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_rasterBackend = (value == RASTER_GDI || value == RASTER_GPU) ? (int)value : RASTER_DIB;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "TargetFPS", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_targetFps = (value > MAX_TARGET_FPS) ? MAX_TARGET_FPS : (int)value;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "VSync", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_vsync = value ? TRUE : FALSE;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "ShowStats", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_showStats = value ? TRUE : FALSE;
+        }
+        
+        /* Path of a per-frame timing CSV; empty or missing disables it */
+        size = sizeof(g_profileCsvPath) - 1;
+        if (RegQueryValueExA(hKey, "ProfileCsv", NULL, NULL, (LPBYTE)g_profileCsvPath, &size) == ERROR_SUCCESS) {
+            g_profileCsvPath[size < sizeof(g_profileCsvPath) ? size : sizeof(g_profileCsvPath) - 1] = '\0';
+        } else {
+            g_profileCsvPath[0] = '\0';
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "RenderThreads", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_renderThreads = (value > MAX_RENDER_THREADS) ? MAX_RENDER_THREADS : (int)value;
+        }
+        
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "FinestLod", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_finestLod = (value > LOD_LEVELS - 1) ? LOD_LEVELS - 1 : (int)value;
+        }
+        
+        /* Non-zero replays the same flight paths every run */
+        size = sizeof(DWORD);
+        if (RegQueryValueExA(hKey, "Seed", NULL, NULL, (LPBYTE)&value, &size) == ERROR_SUCCESS) {
+            g_seed = value;
+        }
+        
         RegCloseKey(hKey);
     }
+    
+    if (g_toasterCount < 1) g_toasterCount = 1;
+    if (g_toasterCount > maxToasterCount()) g_toasterCount = maxToasterCount();
+}
+
+/*
+ * The /p thumbnail keeps running for as long as Display settings is open,
+ * and over RDP every GDI call it makes is remoted. It keeps the configured
+ * look but draws it cheaply: the DIB rasterizer without band workers (one
+ * BitBlt a frame), the PREVIEW_QUALITY level, meshes no finer than
+ * LOD_PREVIEW, and a low frame rate. Only this process's globals change;
+ * nothing is saved.
+ */
+static void applyPreviewSettings(void) {
+    g_swarmMode = FALSE;
+    if (g_toasterCount > MAX_TOASTERS) g_toasterCount = MAX_TOASTERS;
+    g_rasterBackend = RASTER_DIB;
+    g_renderThreads = 1;
+    g_perMonitor = FALSE;
+    g_adaptiveQuality = FALSE;
+    if (g_finestLod < LOD_PREVIEW) g_finestLod = LOD_PREVIEW;
+    g_targetFps = PREVIEW_FPS;
+    g_vsync = FALSE;
+    g_showStats = FALSE;
+    g_profileCsvPath[0] = '\0';     /* the full-screen run's log */
+}
+
+/*
+ * How this session reaches a screen, read once at startup: over RDP or
+ * Citrix every present is encoded and sent, and without DWM there is no
+ * compositor to flip buffers to.
+ */
+static void detectSession(void) {
+    BOOL composited = FALSE;
+    
+    g_remoteSession = g_remoteAware && GetSystemMetrics(SM_REMOTESESSION) != 0;
+    g_composited = !g_remoteSession && SUCCEEDED(DwmIsCompositionEnabled(&composited)) && composited;
+}
+
+/*
+ * A remote session pays for presents in link bandwidth rather than in
+ * GPU time. The software rasterizer without trails only sends the rects
+ * a frame changed (the GPU swap chain and trails both send the whole
+ * back buffer each frame), the frame rate is capped at REMOTE_FPS, and
+ * renderFrame quantizes what it sends. Like applyPreviewSettings, only
+ * this process's globals change.
+ */
+static void applyRemoteSettings(void) {
+    if (g_rasterBackend == RASTER_GPU) g_rasterBackend = RASTER_DIB;
+    g_showTrails = FALSE;
+    if (!g_targetFps || g_targetFps > REMOTE_FPS) g_targetFps = REMOTE_FPS;
+    g_vsync = FALSE;    /* DwmFlush paces the server's desktop, not the client's */
 }
 
 static void saveSettings(void) {
@@ -697,12 +4951,60 @@ static void saveSettings(void) {
         value = g_showScanlines ? 1 : 0;
         RegSetValueExA(hKey, "Scanlines", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
         
+        value = g_scanlineSpacing;
+        RegSetValueExA(hKey, "ScanlineSpacing", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_scanlineIntensity;
+        RegSetValueExA(hKey, "ScanlineIntensity", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
         value = g_showGlow ? 1 : 0;
         RegSetValueExA(hKey, "Glow", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
         
+        value = g_glowAllVertices ? 1 : 0;
+        RegSetValueExA(hKey, "GlowAllVertices", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
         value = g_showTrails ? 1 : 0;
         RegSetValueExA(hKey, "Trails", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
         
+        value = g_swarmMode ? 1 : 0;
+        RegSetValueExA(hKey, "Swarm", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_renderScale;
+        RegSetValueExA(hKey, "RenderScale", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_adaptiveQuality ? 1 : 0;
+        RegSetValueExA(hKey, "AdaptiveQuality", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_powerAware ? 1 : 0;
+        RegSetValueExA(hKey, "PowerAware", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_remoteAware ? 1 : 0;
+        RegSetValueExA(hKey, "RemoteAware", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_perMonitor ? 1 : 0;
+        RegSetValueExA(hKey, "PerMonitor", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_rasterBackend;
+        RegSetValueExA(hKey, "Renderer", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_targetFps;
+        RegSetValueExA(hKey, "TargetFPS", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_vsync ? 1 : 0;
+        RegSetValueExA(hKey, "VSync", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_showStats ? 1 : 0;
+        RegSetValueExA(hKey, "ShowStats", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_renderThreads;
+        RegSetValueExA(hKey, "RenderThreads", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_finestLod;
+        RegSetValueExA(hKey, "FinestLod", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
+        value = g_seed;
+        RegSetValueExA(hKey, "Seed", 0, REG_DWORD, (LPBYTE)&value, sizeof(DWORD));
+        
         RegCloseKey(hKey);
     }
 }
@@ -716,6 +5018,84 @@ static void saveSettings(void) {
 #define IDC_SCANLINES        1003
 #define IDC_GLOW             1004
 #define IDC_TRAILS           1005
+#define IDC_SWARM            1006
+#define IDC_FRAMERATE        1007
+#define IDC_RENDERSCALE      1008
+
+/* Frame rate choices; fps 0 with vsync = DwmFlush, fps 0 alone = uncapped */
+static const struct {
+    const char* label;
+    int fps;
+    BOOL vsync;
+} k_frameRates[] = {
+    { "Display refresh (VSync)", 0, TRUE },
+    { "30 FPS", 30, FALSE },
+    { "60 FPS", 60, FALSE },
+    { "120 FPS", 120, FALSE },
+    { "144 FPS", 144, FALSE },
+    { "Uncapped", 0, FALSE },
+};
+#define FRAME_RATE_CHOICES  (int)(sizeof(k_frameRates) / sizeof(k_frameRates[0]))
+
+static void initFrameRateCombo(HWND hCombo) {
+    int i, selected = -1;
+    
+    for (i = 0; i < FRAME_RATE_CHOICES; i++) {
+        SendMessageA(hCombo, CB_ADDSTRING, 0, (LPARAM)k_frameRates[i].label);
+        if (k_frameRates[i].vsync == g_vsync &&
+            (g_vsync || k_frameRates[i].fps == g_targetFps)) {
+            selected = i;
+        }
+    }
+    
+    /* A TargetFPS set directly in the registry gets its own entry */
+    if (selected < 0) {
+        char buf[32];
+        wsprintfA(buf, "Custom (%d FPS)", g_targetFps);
+        SendMessageA(hCombo, CB_ADDSTRING, 0, (LPARAM)buf);
+        selected = FRAME_RATE_CHOICES;
+    }
+    SendMessage(hCombo, CB_SETCURSEL, selected, 0);
+}
+
+static void readFrameRateCombo(HWND hCombo) {
+    int sel = (int)SendMessage(hCombo, CB_GETCURSEL, 0, 0);
+    if (sel >= 0 && sel < FRAME_RATE_CHOICES) {
+        g_targetFps = k_frameRates[sel].fps;
+        g_vsync = k_frameRates[sel].vsync;
+    }
+}
+
+static void initRenderScaleCombo(HWND hCombo) {
+    int i;
+    
+    for (i = 0; i < RENDER_SCALE_CHOICES; i++) {
+        SendMessageA(hCombo, CB_ADDSTRING, 0, (LPARAM)k_renderScales[i].label);
+    }
+    SendMessage(hCombo, CB_SETCURSEL, findRenderScale(g_renderScale), 0);
+}
+
+static void readRenderScaleCombo(HWND hCombo) {
+    int sel = (int)SendMessage(hCombo, CB_GETCURSEL, 0, 0);
+    if (sel >= 0 && sel < RENDER_SCALE_CHOICES) {
+        g_renderScale = k_renderScales[sel].percent;
+    }
+}
+
+static void updateSliderRange(HWND hSlider, HWND hLabel) {
+    char buf[32];
+    int maxCount = maxToasterCount();
+    
+    if (g_toasterCount > maxCount) g_toasterCount = maxCount;
+    
+    SendMessage(hSlider, TBM_SETRANGE, TRUE, MAKELONG(1, maxCount));
+    SendMessage(hSlider, TBM_SETTICFREQ, g_swarmMode ? 500 : 1, 0);
+    SendMessage(hSlider, TBM_SETPAGESIZE, 0, g_swarmMode ? 100 : 1);
+    SendMessage(hSlider, TBM_SETPOS, TRUE, g_toasterCount);
+    
+    wsprintfA(buf, "Toasters: %d", g_toasterCount);
+    SetWindowTextA(hLabel, buf);
+}
 
 static INT_PTR CALLBACK ConfigDialogProc(HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam) {
     static HWND hSlider;
@@ -728,18 +5108,14 @@ static INT_PTR CALLBACK ConfigDialogProc(HWND hDlg, UINT msg, WPARAM wParam, LPA
             hSlider = GetDlgItem(hDlg, IDC_TOASTER_SLIDER);
             hLabel = GetDlgItem(hDlg, IDC_TOASTER_LABEL);
             
-            SendMessage(hSlider, TBM_SETRANGE, TRUE, MAKELONG(1, MAX_TOASTERS));
-            SendMessage(hSlider, TBM_SETPOS, TRUE, g_toasterCount);
-            
-            {
-                char buf[32];
-                wsprintfA(buf, "Toasters: %d", g_toasterCount);
-                SetWindowTextA(hLabel, buf);
-            }
+            updateSliderRange(hSlider, hLabel);
             
             CheckDlgButton(hDlg, IDC_SCANLINES, g_showScanlines ? BST_CHECKED : BST_UNCHECKED);
             CheckDlgButton(hDlg, IDC_GLOW, g_showGlow ? BST_CHECKED : BST_UNCHECKED);
             CheckDlgButton(hDlg, IDC_TRAILS, g_showTrails ? BST_CHECKED : BST_UNCHECKED);
+            CheckDlgButton(hDlg, IDC_SWARM, g_swarmMode ? BST_CHECKED : BST_UNCHECKED);
+            initFrameRateCombo(GetDlgItem(hDlg, IDC_FRAMERATE));
+            initRenderScaleCombo(GetDlgItem(hDlg, IDC_RENDERSCALE));
             
             return TRUE;
             
@@ -754,10 +5130,17 @@ static INT_PTR CALLBACK ConfigDialogProc(HWND hDlg, UINT msg, WPARAM wParam, LPA
             
         case WM_COMMAND:
             switch (LOWORD(wParam)) {
+                case IDC_SWARM:
+                    g_swarmMode = IsDlgButtonChecked(hDlg, IDC_SWARM) == BST_CHECKED;
+                    updateSliderRange(hSlider, hLabel);
+                    return TRUE;
+                    
                 case IDOK:
                     g_showScanlines = IsDlgButtonChecked(hDlg, IDC_SCANLINES) == BST_CHECKED;
                     g_showGlow = IsDlgButtonChecked(hDlg, IDC_GLOW) == BST_CHECKED;
                     g_showTrails = IsDlgButtonChecked(hDlg, IDC_TRAILS) == BST_CHECKED;
+                    readFrameRateCombo(GetDlgItem(hDlg, IDC_FRAMERATE));
+                    readRenderScaleCombo(GetDlgItem(hDlg, IDC_RENDERSCALE));
                     saveSettings();
                     EndDialog(hDlg, IDOK);
                     return TRUE;
@@ -783,54 +5166,96 @@ static INT_PTR CALLBACK ConfigDialogProc(HWND hDlg, UINT msg, WPARAM wParam, LPA
 LRESULT WINAPI ScreenSaverProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
         case WM_CREATE:
-            srand((unsigned int)time(NULL));
+            g_startTime = qpcNow();
             loadSettings();
             
-            /* Get screen dimensions */
+            /*
+             * Get screen dimensions and build the renderer, then render the
+             * first frame into the back buffer here: the window is still
+             * hidden, but the /p preview is recreated every time the
+             * settings change, and this puts a finished frame behind the
+             * first WM_PAINT. Swarm frames take too long to hold up
+             * creation, and the GPU presents only from its swap chain, so
+             * those wait for the loops.
+             */
             {
                 RECT rect;
-                GetClientRect(hWnd, &rect);
-                g_screenWidth = rect.right;
-                g_screenHeight = rect.bottom;
-            }
-            
-            /* Create double buffer */
-            {
                 HDC hdc = GetDC(hWnd);
-                g_memDC = CreateCompatibleDC(hdc);
-                g_memBitmap = CreateCompatibleBitmap(hdc, g_screenWidth, g_screenHeight);
-                g_oldBitmap = (HBITMAP)SelectObject(g_memDC, g_memBitmap);
-                ReleaseDC(hWnd, hdc);
-            }
-            
-            /* Initialize toasters */
-            {
+                BOOL ok;
                 int i;
-                for (i = 0; i < g_toasterCount; i++) {
-                    initToaster(&g_toasters[i]);
+                
+                GetClientRect(hWnd, &rect);
+                g_preview = fChildPreview || rect.right < PREVIEW_MAX_WIDTH;
+                if (g_preview) applyPreviewSettings();
+                detectSession();
+                if (g_remoteSession) applyRemoteSettings();
+                ok = createRenderer(hWnd, hdc, rect.right, rect.bottom);
+                if (g_toasterCount <= MAX_TOASTERS && g_rasterBackend != RASTER_GPU) {
+                    for (i = 0; ok && i < g_sceneCount; i++) {
+                        renderFrame(&g_scenes[i], NULL, 1.0f / DEFAULT_TARGET_FPS);
+                    }
                 }
+                ReleaseDC(hWnd, hdc);
+                if (!ok) return -1;
             }
             
-            /* Start animation timer */
-            SetTimer(hWnd, TIMER_ID, FRAME_INTERVAL, NULL);
+            /* Before the render loops, which read the power state */
+            startPowerMonitor(hWnd);
+            
+            /* Start the render loops; fall back to the animation timer */
+            if (!startSceneLoops(hWnd)) {
+                g_timerInterval = FRAME_INTERVAL;
+                SetTimer(hWnd, TIMER_ID, g_timerInterval, NULL);
+                updateFallbackTimer(hWnd);
+            }
             return 0;
             
         case WM_TIMER:
-            if (wParam == TIMER_ID) {
+            if (wParam == TIMER_ID && g_sceneCount && g_powerState != POWER_DISPLAY_OFF) {
                 HDC hdc = GetDC(hWnd);
-                renderFrame(hdc);
+                int i;
+                for (i = 0; i < g_sceneCount; i++) {
+                    renderFrame(&g_scenes[i], hdc, g_timerInterval / 1000.0f);
+                }
                 ReleaseDC(hWnd, hdc);
             }
             return 0;
             
-        case WM_DESTROY:
-            KillTimer(hWnd, TIMER_ID);
+        /* Every pixel comes from the back buffer; erasing would flash the class brush */
+        case WM_ERASEBKGND:
+            if (g_sceneCount) return 1;
+            break;
+            
+        /* Present the last finished frame; one in flight presents in full instead */
+        case WM_PAINT:
+            if (g_sceneCount) {
+                PAINTSTRUCT ps;
+                int i;
+                
+                BeginPaint(hWnd, &ps);
+                for (i = 0; i < g_sceneCount; i++) {
+                    if (!repaintScene(&g_scenes[i], ps.hdc)) {
+                        InterlockedExchange(&g_scenes[i].repaint, 1);
+                    }
+                }
+                EndPaint(hWnd, &ps);
+                return 0;
+            }
+            break;
             
-            if (g_memDC) {
-                SelectObject(g_memDC, g_oldBitmap);
-                DeleteObject(g_memBitmap);
-                DeleteDC(g_memDC);
+        case WM_POWERBROADCAST:
+            if (wParam == PBT_POWERSETTINGCHANGE) {
+                onPowerSettingChange(hWnd, (const POWERBROADCAST_SETTING*)lParam);
+                return TRUE;
             }
+            break;
+            
+        case WM_DESTROY:
+            KillTimer(hWnd, TIMER_ID);
+            g_timerInterval = 0;
+            stopSceneLoops();
+            stopPowerMonitor();
+            destroyRenderer();
             
             PostQuitMessage(0);
             return 0;
@@ -846,3 +5271,5 @@ BOOL WINAPI ScreenSaverConfigureDialog(HWND hDlg, UINT msg, WPARAM wParam, LPARA
 BOOL WINAPI RegisterDialogClasses(HANDLE hInst) {
     return TRUE;
 }
+
+#endif /* FT_BENCHMARK */